@@ -17,31 +17,83 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "common/bsp_interface.h"
-#include "common/timers.h"
+#include "common/frame.h"
+#include "common/scheduler.h"
 
 #include "controller.h"
 #include "display.h"
 #include "led.h"
 #include "score_keeper.h"
 
+/* The controller runs first, as soon as an input changes or it asks to */
+#define CONTROLLER_PRIORITY 0
+#define CONTROLLER_PERIOD   0
+
+/* The display is sent its changes after, every few ticks */
+#define DISPLAY_PRIORITY    1
+#define DISPLAY_PERIOD      10
+
+static task_t controllerTask;
+static task_t displayTask;
+
+/* Time awake and asleep in each controller state, read with the debugger */
+static scheduler_duty_t stateDuty[CONTROLLER_NUMBER_OF_STATES];
+
+/**
+ * @brief Runs the controller as soon as an input event is queued
+ */
+static void InputQueued(void)
+{
+    Scheduler_SignalFromInterrupt(&controllerTask);
+}
+
+/**
+ * @brief Runs the controller when it has work without an input event
+ */
+static void ControllerWakeup(void)
+{
+    Scheduler_Signal(&controllerTask);
+}
+
+/**
+ * @brief Accounts the time awake and asleep to the new controller state
+ *
+ * @param state The new controller state
+ */
+static void StateChanged(controller_state_t state)
+{
+    Scheduler_AccountDuty(&stateDuty[state]);
+}
+
 void Initialize(void)
 {
 	BSPInterface_Initialize();
+
+    /* The modules initialize from the same first frame */
+    Frame_Capture();
+
     LED_Initialize();
     Display_Initialize();
     Controller_Initialize();
     ScoreKeeper_Initialize();
+
+    /* The LEDs are driven by the controller and their timers, they have */
+    /* no task of their own                                              */
+    Scheduler_AddTask(&controllerTask, Controller_Run, CONTROLLER_PRIORITY, CONTROLLER_PERIOD);
+    Scheduler_AddTask(&displayTask, Display_Run, DISPLAY_PRIORITY, DISPLAY_PERIOD);
+
+    /* Between input events the controller only has work when it says so, */
+    /* starting with its first run                                        */
+    Controller_SetWakeup(ControllerWakeup);
+    (void)Controller_Subscribe(StateChanged);
+    Scheduler_Signal(&controllerTask);
+
+    BSPInterface_SetInputListener(InputQueued);
 }
 
 int main(void)
 {
     Initialize();
 
-    for(;;)
-    {
-        Controller_Run();
-        Display_Run();
-        LED_Run();
-    }
+    Scheduler_Run();
 }
-
@@ -18,9 +18,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "controller.h"
 
+#include <stddef.h>
 #include <stdint.h>
+#include <avr/pgmspace.h>
 
 #include "common/bsp_interface.h"
+#include "common/frame.h"
 #include "common/timers.h"
 
 #include "bsp/bsp.h"
@@ -31,40 +34,53 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define STARTUP_TIME   5000
 #define SHOWSCORE_TIME 5000
 
+/* The events, and the states, as lists so they can be iterated over to */
+/* resolve the transitions at build time                                */
+#define EVENTS(X, a)         \
+    X(EV_NONE,        a)     \
+    X(EV_LEFTPOST,    a)     \
+    X(EV_BUZZ,        a)     \
+    X(EV_RIGHTPOST,   a)     \
+    X(EV_TIMEREXPIRE, a)
+
+#define STATES(X, a)         \
+    X(ST_INITIALIZE,  a)     \
+    X(ST_BOOTUP,      a)     \
+    X(ST_WAITING,     a)     \
+    X(ST_BEGIN,       a)     \
+    X(ST_START,       a)     \
+    X(ST_RUNNING,     a)     \
+    X(ST_BUZZ,        a)     \
+    X(ST_DONE,        a)     \
+    X(ST_SHOWSCORE,   a)
+
+#define HANDLERS(X)          \
+    X(Initialize)            \
+    X(Bootup)                \
+    X(Waiting)               \
+    X(Begin)                 \
+    X(Start)                 \
+    X(Running)               \
+    X(Buzz)                  \
+    X(Done)                  \
+    X(ShowScore)
+
+#define ENUMERATE(name, a) name,
+
 typedef enum
 {
-    EV_NONE = 0,
-    EV_LEFTPOST,
-    EV_BUZZ,
-    EV_RIGHTPOST,
-    EV_TIMEREXPIRE,
+    EVENTS(ENUMERATE, 0)
     EV_ANY
 } event_t;
 
 typedef enum
 {
-    ST_INITIALIZE = 0,
-    ST_BOOTUP,
-    ST_WAITING,
-    ST_BEGIN,
-    ST_START,
-    ST_RUNNING,
-    ST_BUZZ,
-    ST_DONE,
-    ST_SHOWSCORE,
+    STATES(ENUMERATE, 0)
     ST_ANY
 } state_t;
 
 typedef const event_t (*handler_fp)(void);
 
-typedef struct
-{
-    state_t state;
-    event_t event;
-    handler_fp handler;
-    state_t next;
-} transition_t;
-
 static const event_t Initialize(void);
 static const event_t Bootup(void);
 static const event_t Waiting(void);
@@ -75,41 +91,179 @@ static const event_t Buzz(void);
 static const event_t Done(void);
 static const event_t ShowScore(void);
 
-static const transition_t transistions[] =
+#define HANDLER_ID(handler) HANDLER_##handler,
+#define HANDLER_FP(handler) handler,
+
+typedef enum
 {
-    { ST_INITIALIZE, EV_ANY,         Bootup,     ST_BOOTUP     },
-    { ST_BOOTUP,     EV_TIMEREXPIRE, Waiting,    ST_WAITING    },
-    { ST_BOOTUP,     EV_ANY,         Bootup,     ST_BOOTUP     },
-    { ST_WAITING,    EV_LEFTPOST,    Begin,      ST_BEGIN      },
-    { ST_WAITING,    EV_ANY,         Waiting,    ST_WAITING    },
-    { ST_BEGIN,      EV_LEFTPOST,    Begin,      ST_BEGIN      },
-    { ST_BEGIN,      EV_ANY,         Start,      ST_START      },
-    { ST_START,      EV_ANY,         Running,    ST_RUNNING    },
-    { ST_RUNNING,    EV_RIGHTPOST,   Done,       ST_DONE       },
-    { ST_RUNNING,    EV_BUZZ,        Buzz,       ST_BUZZ       },
-    { ST_RUNNING,    EV_ANY,         Running,    ST_RUNNING    },
-    { ST_BUZZ,       EV_RIGHTPOST,   Done,       ST_DONE       },
-    { ST_BUZZ,       EV_TIMEREXPIRE, Running,    ST_RUNNING    },
-    { ST_BUZZ,       EV_ANY,         Buzz,       ST_BUZZ       },
-    { ST_DONE,       EV_ANY,         ShowScore,  ST_SHOWSCORE  },
-    { ST_SHOWSCORE,  EV_TIMEREXPIRE, Waiting,    ST_WAITING    },
-    { ST_SHOWSCORE,  EV_ANY,         ShowScore,  ST_SHOWSCORE  },
-    { ST_ANY,        EV_ANY,         Initialize, ST_INITIALIZE }
+    HANDLERS(HANDLER_ID)
+    HANDLER_COUNT
+} handler_t;
 
+static const handler_fp handlers[HANDLER_COUNT] =
+{
+    HANDLERS(HANDLER_FP)
 };
 
-#define TRANSISTIONS_COUNT (sizeof(transistions) / sizeof(transition_t))
+/*
+ * The transitions.  For the current state and the event its handler
+ * returned, the first row for that state, or ST_ANY, and that event, or
+ * EV_ANY, is taken.  The handler of the row becomes the handler of the
+ * next state.
+ *
+ * This is the only definition of the state machine, each ROW is given the
+ * state S and event E being resolved, @see dispatch
+ */
+#define TRANSITIONS(ROW, S, E)                                                \
+    ROW(S, E, ST_INITIALIZE, EV_ANY,         Bootup,     ST_BOOTUP     )     \
+    ROW(S, E, ST_BOOTUP,     EV_TIMEREXPIRE, Waiting,    ST_WAITING    )     \
+    ROW(S, E, ST_BOOTUP,     EV_ANY,         Bootup,     ST_BOOTUP     )     \
+    ROW(S, E, ST_WAITING,    EV_LEFTPOST,    Begin,      ST_BEGIN      )     \
+    ROW(S, E, ST_WAITING,    EV_ANY,         Waiting,    ST_WAITING    )     \
+    ROW(S, E, ST_BEGIN,      EV_LEFTPOST,    Begin,      ST_BEGIN      )     \
+    ROW(S, E, ST_BEGIN,      EV_ANY,         Start,      ST_START      )     \
+    ROW(S, E, ST_START,      EV_ANY,         Running,    ST_RUNNING    )     \
+    ROW(S, E, ST_RUNNING,    EV_RIGHTPOST,   Done,       ST_DONE       )     \
+    ROW(S, E, ST_RUNNING,    EV_BUZZ,        Buzz,       ST_BUZZ       )     \
+    ROW(S, E, ST_RUNNING,    EV_ANY,         Running,    ST_RUNNING    )     \
+    ROW(S, E, ST_BUZZ,       EV_RIGHTPOST,   Done,       ST_DONE       )     \
+    ROW(S, E, ST_BUZZ,       EV_TIMEREXPIRE, Running,    ST_RUNNING    )     \
+    ROW(S, E, ST_BUZZ,       EV_ANY,         Buzz,       ST_BUZZ       )     \
+    ROW(S, E, ST_DONE,       EV_ANY,         ShowScore,  ST_SHOWSCORE  )     \
+    ROW(S, E, ST_SHOWSCORE,  EV_TIMEREXPIRE, Waiting,    ST_WAITING    )     \
+    ROW(S, E, ST_SHOWSCORE,  EV_ANY,         ShowScore,  ST_SHOWSCORE  )
+
+/* Whether a row applies to a state and event */
+#define ROW_APPLIES(S, E, state, event)                                       \
+    ((((state) == (S)) || (ST_ANY == (state))) &&                             \
+     (((event) == (E)) || (EV_ANY == (event))))
+
+/* A resolved transition, the next state and its handler in a byte */
+#define DISPATCH(next, handler)  ((uint8_t)(((next) << 4) | (handler)))
+#define DISPATCH_NEXT(dispatch)  ((state_t)((dispatch) >> 4))
+#define DISPATCH_HANDLER(dispatch) ((handler_t)((dispatch) & 0x0F))
+
+#define RESOLVE_ROW(S, E, state, event, handler, next)                        \
+    ROW_APPLIES(S, E, state, event) ? DISPATCH(next, HANDLER_##handler) :
+
+/* The transition of the first row that applies */
+#define RESOLVE(E, S) (TRANSITIONS(RESOLVE_ROW, S, E) 0xFF),
+#define RESOLVE_STATE(S, a) { EVENTS(RESOLVE, S) },
+
+/*
+ * The transitions resolved for every state and event, with the wildcards
+ * and the row order already applied
+ */
+static const uint8_t dispatch[ST_ANY][EV_ANY] PROGMEM =
+{
+    STATES(RESOLVE_STATE, 0)
+};
 
-static transition_t current;
+/*
+ * Build time checks of the transitions.  Each row is identified by a bit,
+ * set for the rows that some state and event resolve to, so the table
+ * is incomplete if the bit for no row is set, and a row is unreachable if
+ * its bit is not set
+ */
+#define CONTROLLER_CHECK(name, condition) typedef char name[(condition) ? 1 : -1]
+
+#define ROW_BIT(state, event) (1ULL << (((state) * (EV_ANY + 1)) + (event)))
+#define NO_ROW_BIT            (1ULL << 63)
+
+#define ROW_BIT_OF(S, E, state, event, handler, next) + ROW_BIT(state, event)
+#define ROW_MASK_OF(S, E, state, event, handler, next) | ROW_BIT(state, event)
+
+#define REACHED_ROW(S, E, state, event, handler, next)                        \
+    ROW_APPLIES(S, E, state, event) ? ROW_BIT(state, event) :
+#define REACHED(E, S) | (TRANSITIONS(REACHED_ROW, S, E) NO_ROW_BIT)
+#define REACHED_STATE(S, a) EVENTS(REACHED, S)
+
+#define ALL_ROWS     (0 TRANSITIONS(ROW_MASK_OF, 0, 0))
+#define ROWS_REACHED (0 STATES(REACHED_STATE, 0))
+
+CONTROLLER_CHECK(controller_rows_fit, (ST_ANY + 1) * (EV_ANY + 1) <= 63);
+CONTROLLER_CHECK(controller_dispatch_fits, (ST_ANY <= 16) && (HANDLER_COUNT <= 16));
+CONTROLLER_CHECK(controller_rows_unique, ALL_ROWS == (0 TRANSITIONS(ROW_BIT_OF, 0, 0)));
+CONTROLLER_CHECK(controller_table_complete, 0 == (ROWS_REACHED & NO_ROW_BIT));
+CONTROLLER_CHECK(controller_rows_reachable, ALL_ROWS == (ROWS_REACHED & ~NO_ROW_BIT));
+
+static state_t currentState;
+static handler_t currentHandler;
 static timer_t timer;
 
-static bool leftPostHit;
-static bool rightPostHit;
-static bool wireHit;
+/* Called when there is work without an input event */
+static controller_wakeup_t wakeupCallback;
+
+/* Listeners to state changes, and the state they were last told about */
+static controller_listener_t listeners[CONTROLLER_LISTENERS];
+static uint8_t listenerCount;
+static controller_state_t publishedState;
+static bool published;
+
+/* Input event being handled, if one is pending */
+static bsp_input_event_t input;
+static bool inputPending;
+
+/* Whether each input is held, followed through its events rather than */
+/* read from the frame, which already has the events still queued      */
+static bool inputHeld[BSP_NUMBER_OF_INPUTS];
+
+/* When the input that raised the last event occurred */
+static bsp_timestamp_t inputTime;
+
+/**
+ * @brief Queries if an input is contacted
+ *
+ * An input is contacted if the event being handled is its contact, however
+ * short, or if the contact is held as of that event
+ *
+ * @param id The input
+ *
+ * @return true if contacted, in which case inputTime is set to the time
+ *         of the contact
+ */
+static bool Contacted(bsp_inputs_t id)
+{
+    if (inputPending && (input.id == id) && input.state)
+    {
+        inputTime = input.timestamp;
+        return true;
+    }
+
+    if (inputHeld[id])
+    {
+        Frame_GetTimestamp(&inputTime);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Asks to be run again
+ */
+static void Wake(void)
+{
+    if (NULL != wakeupCallback)
+    {
+        wakeupCallback();
+    }
+}
+
+/**
+ * @brief Asks to be run when the timer expires
+ *
+ * @param context Unused
+ */
+static void TimerExpired(void *context)
+{
+    Wake();
+}
 
 static const event_t Initialize(void)
 {
     Timer_Initialize(&timer, TIMER_MODE_SINGLE, 5000);
+    Timer_SetCallback(&timer, TimerExpired, NULL);
     Timer_Reset(&timer);
     return EV_NONE;
 }
@@ -130,7 +284,7 @@ static const event_t Waiting(void)
 {
     event_t event = EV_NONE;
 
-    if (leftPostHit)
+    if (inputHeld[BSP_INPUT_BUZZ_LEFT_POST])
     {
         event = EV_LEFTPOST;
     }
@@ -142,10 +296,20 @@ static const event_t Begin(void)
 {
     event_t event = EV_LEFTPOST;
 
-    /* Start the game when we leave the left post */
-    if (!leftPostHit)
+    /* Start the game when we leave the left post, timed from the event */
+    /* that left it rather than from this step                          */
+    if (!inputHeld[BSP_INPUT_BUZZ_LEFT_POST])
     {
         event = EV_NONE;
+
+        if (inputPending && (BSP_INPUT_BUZZ_LEFT_POST == input.id))
+        {
+            inputTime = input.timestamp;
+        }
+        else
+        {
+            Frame_GetTimestamp(&inputTime);
+        }
     }
 
     return event;
@@ -153,7 +317,8 @@ static const event_t Begin(void)
 
 static const event_t Start(void)
 {
-    ScoreKeeper_Start();
+    ScoreKeeper_Start(&inputTime);
+
     return EV_NONE;
 }
 
@@ -162,11 +327,11 @@ static const event_t Running(void)
     event_t event = EV_NONE;
 
     /* Winning the game takes priority */
-    if (rightPostHit)
+    if (Contacted(BSP_INPUT_BUZZ_RIGHT_POST))
     {
         event = EV_RIGHTPOST;
     }
-    else if (wireHit)
+    else if (Contacted(BSP_INPUT_BUZZ_WIRE))
     {
         event = EV_BUZZ;
         Timer_SetTimeoutPeriod(&timer, BUZZ_TIME);
@@ -182,7 +347,7 @@ static const event_t Buzz(void)
     event_t event = EV_NONE;
 
     /* Winning the game takes priority */
-    if (rightPostHit)
+    if (Contacted(BSP_INPUT_BUZZ_RIGHT_POST))
     {
         event = EV_RIGHTPOST;
     }
@@ -195,7 +360,8 @@ static const event_t Buzz(void)
 }
 static const event_t Done(void)
 {
-    ScoreKeeper_End();
+    ScoreKeeper_End(&inputTime);
+
     Timer_SetTimeoutPeriod(&timer, SHOWSCORE_TIME);
     Timer_Reset(&timer);
 
@@ -214,49 +380,18 @@ static const event_t ShowScore(void)
     return event;
 }
 
-void Controller_Initialize(void)
-{
-    current.state = ST_INITIALIZE;
-    current.handler = Initialize;
-
-    Timer_Initialize(&timer, TIMER_MODE_SINGLE, 0);
-}
-
-void Controller_Run(void)
-{
-    uint8_t i;
-    event_t event;
-
-    leftPostHit  = BSPInterface_GetInputState(BSP_INPUT_BUZZ_LEFT_POST);
-    rightPostHit = BSPInterface_GetInputState(BSP_INPUT_BUZZ_RIGHT_POST);
-    wireHit      = BSPInterface_GetInputState(BSP_INPUT_BUZZ_WIRE);
-
-    event = current.handler();
-
-    for (i = 0; i < TRANSISTIONS_COUNT; i++)
-    {
-        if ((transistions[i].state == current.state) || (ST_ANY == transistions[i].state))
-        {
-            if ((transistions[i].event == event) || (EV_ANY == transistions[i].event))
-            {
-                current = transistions[i];
-                current.state = current.next;
-                break;
-            }
-        }
-    }
-
-    if (i >= TRANSISTIONS_COUNT)
-    {
-        Controller_Initialize();
-    }
-}
-
-const controller_state_t Controller_GetState(void)
+/**
+ * @brief Maps a state of the state machine to the state it shows outside
+ *
+ * @param internal The state machine state
+ *
+ * @return Controller state
+ */
+static controller_state_t PublicState(state_t internal)
 {
     controller_state_t state;
 
-    switch (current.state)
+    switch (internal)
     {
     case ST_WAITING:
         state = STATE_WAITING;
@@ -285,3 +420,140 @@ const controller_state_t Controller_GetState(void)
     return state;
 }
 
+/**
+ * @brief Tells the listeners if the controller state changed
+ */
+static void Publish(void)
+{
+    const controller_state_t state = PublicState(currentState);
+    uint8_t i;
+
+    if (published && (state == publishedState))
+    {
+        return;
+    }
+
+    publishedState = state;
+    published = true;
+
+    for (i = 0; i < listenerCount; i++)
+    {
+        listeners[i](state);
+    }
+}
+
+/**
+ * @brief Queries if a handler passes straight through to the next state
+ *
+ * Those handlers do not look at the inputs, so the input event pending
+ * is kept for the state they pass to
+ *
+ * @param id The handler
+ *
+ * @return true if the handler passes through
+ */
+static bool PassesThrough(handler_t id)
+{
+    return (HANDLER_Initialize == id) || (HANDLER_Start == id) || (HANDLER_Done == id);
+}
+
+/**
+ * @brief Runs the handler of the current state and takes the transition
+ */
+static void Step(void)
+{
+    event_t event;
+    uint8_t next;
+
+    event = handlers[currentHandler]();
+
+    if (!PassesThrough(currentHandler))
+    {
+        inputPending = false;
+    }
+
+    next = pgm_read_byte(&dispatch[currentState][event]);
+
+    currentState = DISPATCH_NEXT(next);
+    currentHandler = DISPATCH_HANDLER(next);
+}
+
+void Controller_Initialize(void)
+{
+    uint8_t id;
+
+    currentState = ST_INITIALIZE;
+    currentHandler = HANDLER_Initialize;
+
+    /* Listeners are told about the first state, whichever it is */
+    publishedState = STATE_INITIALIZE;
+    published = false;
+
+    inputPending = false;
+
+    for (id = 0; id < BSP_NUMBER_OF_INPUTS; id++)
+    {
+        inputHeld[id] = Frame_GetInputState(id);
+    }
+
+    Timer_Initialize(&timer, TIMER_MODE_SINGLE, 0);
+    Timer_SetCallback(&timer, TimerExpired, NULL);
+}
+
+void Controller_Run(void)
+{
+    const state_t previous = currentState;
+    bool more;
+
+    /* Each queued input event is handled by a step of its own, in the */
+    /* order they occurred, and the last step is run with no event.     */
+    /* States that pass through are left in the same run, so only the   */
+    /* state that is settled in is published                             */
+    do
+    {
+        if (!inputPending)
+        {
+            inputPending = BSPInterface_GetInputEvent(&input);
+
+            if (inputPending && (BSP_NUMBER_OF_INPUTS > input.id))
+            {
+                inputHeld[input.id] = input.state;
+            }
+        }
+
+        more = inputPending;
+
+        Step();
+    } while (more || PassesThrough(currentHandler));
+
+    /* The handler of a new state looks at the held inputs and the timer */
+    /* it was left with, without waiting for them to change              */
+    if (previous != currentState)
+    {
+        Wake();
+    }
+
+    Publish();
+}
+
+const controller_state_t Controller_GetState(void)
+{
+    return publishedState;
+}
+
+bool Controller_Subscribe(controller_listener_t listener)
+{
+    if (CONTROLLER_LISTENERS <= listenerCount)
+    {
+        return false;
+    }
+
+    listeners[listenerCount++] = listener;
+
+    return true;
+}
+
+void Controller_SetWakeup(controller_wakeup_t wakeup)
+{
+    wakeupCallback = wakeup;
+}
@@ -19,6 +19,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef __BUZZWIRE_CONTROLLER_H__
 #define __BUZZWIRE_CONTROLLER_H__
 
+#include <stdbool.h>
+
+/**
+ * @brief Maximum number of listeners to state changes
+ */
+#ifndef CONTROLLER_LISTENERS
+#define CONTROLLER_LISTENERS 4
+#endif
 
 typedef enum
 {
@@ -27,9 +35,23 @@ typedef enum
     STATE_BEGIN,
     STATE_RUNNING,
     STATE_BUZZ,
-    STATE_DONE
+    STATE_DONE,
+    CONTROLLER_NUMBER_OF_STATES
 } controller_state_t;
 
+/**
+ * @brief Function called when the controller state changes
+ *
+ * @param state The new controller state
+ */
+typedef void (*controller_listener_t)(controller_state_t state);
+
+/**
+ * @brief Function called when the controller needs to run without an
+ *        input event
+ */
+typedef void (*controller_wakeup_t)(void);
+
 /**
  * @brief Sets up the state machine controller
  */
@@ -37,6 +59,9 @@ void Controller_Initialize(void);
 
 /**
  * @brief Executes the state machine
+ *
+ * It only needs to run when an input event is queued, and when the
+ * wakeup function is called, @see Controller_SetWakeup
  */
 void Controller_Run(void);
 
@@ -47,5 +72,30 @@ void Controller_Run(void);
  */
 const controller_state_t Controller_GetState(void);
 
+/**
+ * @brief Subscribes to controller state changes
+ *
+ * Listeners are called at the end of @see Controller_Run, in the order
+ * they subscribed, when the state changed during the run.  The first
+ * state after initialization is reported as a change
+ *
+ * @param listener Function to call
+ *
+ * @return true if subscribed, false if there are already
+ *         CONTROLLER_LISTENERS listeners
+ */
+bool Controller_Subscribe(controller_listener_t listener);
+
+/**
+ * @brief Sets the function to call when the controller needs to run
+ *        without an input event
+ *
+ * It is called when the controller timer expires, and at the end of a
+ * run that moved to a state that has not looked at the inputs yet
+ *
+ * @param wakeup Function to call, NULL for none
+ */
+void Controller_SetWakeup(controller_wakeup_t wakeup);
+
 #endif /* __BUZZWIRE_CONTROLLER_H__ */
 
@@ -16,8 +16,9 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <stdio.h>
+#include <string.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "common/timers.h"
@@ -25,13 +26,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "lib44780/hd44780_low.h"
 #include "lib44780fw/hd44780fw.h"
+#include "libcustomprocs/customprocs.h"
 
 #include "bsp/bsp.h"
 
 #include "controller.h"
 #include "score_keeper.h"
 
-static const uint8_t leftArrows[8][8] = {
+static const uint8_t leftArrows[8][8] PROGMEM = {
     {0x03, 0x07, 0x0F, 0x1F, 0x1F, 0x0F, 0x07, 0x03},
     {0x00, 0x00, 0x00, 0x1F, 0x01, 0x00, 0x00, 0x00},
     {0x06, 0x0E, 0x1E, 0x1F, 0x1E, 0x1E, 0x0E, 0x06},
@@ -42,7 +44,7 @@ static const uint8_t leftArrows[8][8] = {
     {0x01, 0x03, 0x07, 0x1F, 0x0F, 0x07, 0x03, 0x01}
 };
 
-static const uint8_t rightArrows[8][8] = {
+static const uint8_t rightArrows[8][8] PROGMEM = {
     {0x18, 0x1C, 0x1E, 0x1F, 0x1F, 0x1E, 0x1C, 0x18},
     {0x0C, 0x0E, 0x0F, 0x1F, 0x0F, 0x0F, 0x0E, 0x0C},
     {0x00, 0x00, 0x00, 0x1F, 0x10, 0x00, 0x00, 0x00},
@@ -53,7 +55,7 @@ static const uint8_t rightArrows[8][8] = {
     {0x10, 0x18, 0x1C, 0x1F, 0x1E, 0x1C, 0x18, 0x10}
 };
 
-static const char leftArrowline[5][20] = {
+static const char leftArrowline[5][20] PROGMEM = {
     { '-', '-', '-',  0x00, '-', '-', '-',  0x00, '-', '-', '-',  0x00, '-', '-', '-',  0x00, '-', '-', '-',  0x00 },
     { '-', '-', 0x01, 0x02, '-', '-', 0x01, 0x02, '-', '-', 0x01, 0x02, '-', '-', 0x01, 0x02, '-', '-', 0x01, 0x02 },
     { '-', '-', 0x03, 0x04, '-', '-', 0x03, 0x04, '-', '-', 0x03, 0x04, '-', '-', 0x03, 0x04, '-', '-', 0x03, 0x04 },
@@ -61,7 +63,7 @@ static const char leftArrowline[5][20] = {
     { '-', '-', 0x07, '-',  '-', '-', 0x07, '-',  '-', '-', 0x07, '-',  '-', '-', 0x07, '-',  '-', '-', 0x07, '-'  }
 };
 
-static const char rightArrowline[5][20] = {
+static const char rightArrowline[5][20] PROGMEM = {
     { 0x00, '-',  '-', '-', 0x00, '-',  '-', '-', 0x00, '-',  '-', '-', 0x00, '-',  '-', '-', 0x00, '-',  '-', '-' },
     { 0x01, 0x02, '-', '-', 0x01, 0x02, '-', '-', 0x01, 0x02, '-', '-', 0x01, 0x02, '-', '-', 0x01, 0x02, '-', '-' },
     { 0x03, 0x04, '-', '-', 0x03, 0x04, '-', '-', 0x03, 0x04, '-', '-', 0x03, 0x04, '-', '-', 0x03, 0x04, '-', '-' },
@@ -69,15 +71,17 @@ static const char rightArrowline[5][20] = {
     { '-',  0x07, '-', '-', '-',  0x07, '-', '-', '-',  0x07, '-', '-', '-',  0x07, '-', '-', '-',  0x07, '-', '-' }
 };
 
-static const uint8_t antiasterik[8] = {0x00, 0x0A, 0x04, 0x1F, 0x04, 0x0A, 0x00, 0x00};
+static const uint8_t antiasterik[8] PROGMEM = {0x00, 0x0A, 0x04, 0x1F, 0x04, 0x0A, 0x00, 0x00};
 
-static const char buzzline[2][16] = {
+static const char buzzline[2][16] PROGMEM = {
     { '*',   0x00, '*',  0x00, '*',  ' ', 'B', 'U', 'Z', 'Z', ' ', 0x00, '*',  0x00, '*',  0x00 },
     { 0x00,  '*',  0x00, '*',  0x00, ' ', 'B', 'U', 'Z', 'Z', ' ', '*',  0x00, '*',  0x00, '*'  }
 };
 
-static const char startInstructions[] = "Touch ring to start... Touch ring to s";
-static const char winInstructions[] = "Touch ring to win... Touch ring to w";
+static const char startInstructions[] PROGMEM = "Touch ring to start... ";
+static const char winInstructions[] PROGMEM = "Touch ring to win... ";
+static const char runLine[] PROGMEM = "RUN    0.0 TOUCH";
+static const char totalLine[] PROGMEM = "TOT    0.0     0";
 static struct hd44780_l_conf low_conf;
 static struct hd44780fw_conf fw_conf;
 
@@ -87,8 +91,8 @@ static timer_t slowTimer;
 
 static bool scoreToggle;
 
+static uint8_t buzzGlyph;
 static uint8_t arrowIndex;
-static uint8_t instructionIndex;
 static uint8_t group;
 static uint8_t idx;
 
@@ -104,241 +108,288 @@ static controller_state_t state;
  * Less than 10 minutes: 'x:xx.x'
  * More than 10 minutes: ' xx:xx'
  *
+ * The digits are taken straight from the BCD nibbles
+ *
  * @param s Pointer to a 7-char array
- * @param ms Time in milliseconds to display
+ * @param time Time to display
  */
-static void BuildTimeString(char *s, uint32_t ms)
+static void BuildTimeString(char *s, const bcd_time_t *time)
 {
-    uint16_t minutes = ms / 60000;
-    double seconds = (ms % 60000) / 1000.0f;
+    const uint8_t minutes = (uint8_t)time->minutes;
+    const uint8_t hundreds = (uint8_t)(time->minutes >> 8);
 
-    if (0 < minutes)
+    if (0 < time->minutes)
     {
-        if (10 <= minutes)
-        {
-            sprintf(s, "%3d:%02.0f", minutes, seconds);
-        }
-        else
+        if (0x10 <= time->minutes)
         {
-            sprintf(s, "%d:%04.1f", minutes, seconds);
+            s[0] = (0 < hundreds) ? '0' + hundreds : ' ';
+            s[1] = '0' + (minutes >> 4);
+            s[2] = '0' + (minutes & 0x0F);
+            s[3] = ':';
+            s[4] = '0' + (time->seconds >> 4);
+            s[5] = '0' + (time->seconds & 0x0F);
+            s[6] = '\0';
+            return;
         }
+
+        s[0] = '0' + minutes;
+        s[1] = ':';
+        s[2] = '0' + (time->seconds >> 4);
     }
     else
     {
-        sprintf(s, "%6.1f", seconds);
+        s[0] = ' ';
+        s[1] = ' ';
+        s[2] = (0x10 <= time->seconds) ? '0' + (time->seconds >> 4) : ' ';
     }
+
+    s[3] = '0' + (time->seconds & 0x0F);
+    s[4] = '.';
+    s[5] = '0' + time->tenths;
+    s[6] = '\0';
 }
 
-static void DisplayWait(void)
+/**
+ * @brief Builds a rank string, '#' and the rank
+ *
+ * @param s Pointer to an array of at least 5 chars
+ * @param rank Rank to display, 0 or more
+ */
+static void BuildRankString(char *s, int8_t rank)
 {
-    if (Timer_Timeout(&quickTimer))
-    {
-        arrowIndex = (arrowIndex + 1) % 20;
+    char n[4];
 
-        group = arrowIndex % 5;
+    s[0] = '#';
+    strcpy(&s[1], cp_itoa(n, sizeof(n), rank, 10));
+}
 
-        if (0 == group)
-        {
-            idx = (idx + 1) % 4;
-        }
+static void DisplayWait(void)
+{
+    arrowIndex = (arrowIndex + 1) % 20;
 
-        hd44780fw_write_len(&fw_conf, &leftArrowline[group][idx], 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
-    }
+    group = arrowIndex % 5;
 
-    if (Timer_Timeout(&mediumTimer))
+    if (0 == group)
     {
-        instructionIndex = (instructionIndex + 1) % 23;
-        hd44780fw_write_len(&fw_conf, &startInstructions[instructionIndex], 16, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
+        idx = (idx + 1) % 4;
     }
+
+    hd44780fw_write_len_P(&fw_conf, &leftArrowline[group][idx], 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
 }
 
 static void DisplayBegin(void)
 {
-    if (Timer_Timeout(&quickTimer))
-    {
-        arrowIndex = (arrowIndex + 1) % 20;
-
-        group = arrowIndex % 5;
-
-        if (0 == group)
-        {
-            idx--;
-            idx = idx % 4;
-        }
+    arrowIndex = (arrowIndex + 1) % 20;
 
-        hd44780fw_write_len(&fw_conf, &rightArrowline[group][idx], 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
-    }
+    group = arrowIndex % 5;
 
-    if (Timer_Timeout(&mediumTimer))
+    if (0 == group)
     {
-        instructionIndex = (instructionIndex + 1) % 21;
-        hd44780fw_write_len(&fw_conf, &winInstructions[instructionIndex], 16, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
+        idx--;
+        idx = idx % 4;
     }
+
+    hd44780fw_write_len_P(&fw_conf, &rightArrowline[group][idx], 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
 }
 
 static void DisplayRun(void)
 {
-    if (Timer_Timeout(&quickTimer))
-    {
-        char p[6] = "99999";
-        char s[7];
+    char p[6] = "99999";
+    char s[7];
 
-        const score_t score = ScoreKeeper_GetScore();
+    const score_clock_t clock = ScoreKeeper_GetClock();
+    const score_t score = ScoreKeeper_GetLastScore();
 
-        BuildTimeString(s, score.runningTime);
-        hd44780fw_write_len(&fw_conf, s, 6, 4, HD44780FW_WR_NO_CLEAR_BEFORE);
+    /* Only the digits that carried differ from the shadow, so only */
+    /* those reach the display on flush                             */
+    BuildTimeString(s, &clock.runningTime);
+    hd44780fw_write_len(&fw_conf, s, 6, 4, HD44780FW_WR_NO_CLEAR_BEFORE);
 
-        BuildTimeString(s, score.totalTime);
-        hd44780fw_write_len(&fw_conf, s, 6, 20, HD44780FW_WR_NO_CLEAR_BEFORE);
+    BuildTimeString(s, &clock.totalTime);
+    hd44780fw_write_len(&fw_conf, s, 6, 20, HD44780FW_WR_NO_CLEAR_BEFORE);
 
-        if (99999 > score.penalties)
-        {
-            int pp = score.penalties;
-            sprintf(p, "%d", pp);
-        }
+    if (99999 > score.penalties)
+    {
+        char n[6];
+        strcpy(p, cp_ultoa(n, sizeof(n), score.penalties, 10));
+    }
 
-        hd44780fw_write_len(&fw_conf, p, 5, 27, HD44780FW_WR_NO_CLEAR_BEFORE);
+    hd44780fw_write_len(&fw_conf, p, 5, 27, HD44780FW_WR_NO_CLEAR_BEFORE);
+}
+
+/**
+ * @brief Writes a line of the buzz animation
+ *
+ * The lines are declared with the anti-asterisk as character 0, this
+ * substitutes the custom character it actually got
+ *
+ * @param line The 16 character line to write, in program space
+ * @param index Position of the line on the display
+ */
+static void WriteBuzzLine(const char *line, uint8_t index)
+{
+    char s[16];
+    uint8_t i;
+
+    for (i = 0; i < 16; i++)
+    {
+        const char c = pgm_read_byte(&line[i]);
+
+        s[i] = (0x00 == c) ? buzzGlyph : c;
     }
+
+    hd44780fw_write_len(&fw_conf, s, 16, index, HD44780FW_WR_NO_CLEAR_BEFORE);
 }
 
 static void DisplayBuzz(void)
 {
     bool toggle = false;
 
-    if (Timer_Timeout(&quickTimer))
+    if (toggle)
     {
-        if (toggle)
-        {
-            toggle = false;
-            hd44780fw_write_len(&fw_conf, buzzline[0], 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
-            hd44780fw_write_len(&fw_conf, buzzline[1], 16, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-        }
-        else
-        {
-            toggle = true;
-            hd44780fw_write_len(&fw_conf, buzzline[1], 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
-            hd44780fw_write_len(&fw_conf, buzzline[0], 16, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-        }
+        toggle = false;
+        WriteBuzzLine(buzzline[0], 0);
+        WriteBuzzLine(buzzline[1], 16);
+    }
+    else
+    {
+        toggle = true;
+        WriteBuzzLine(buzzline[1], 0);
+        WriteBuzzLine(buzzline[0], 16);
     }
 }
 
 static void DisplayScore(void)
 {
-    if (Timer_Timeout(&slowTimer))
+    if (scoreToggle)
     {
-        if (scoreToggle)
-        {
-            scoreToggle = false;
-            DisplayRun();
-        }
-        else
-        {
-            char r[7] = "NONE  ";
-            char t[7] = "NONE  ";
-            char p[6] = "NONE ";
-            int rRank = ScoreKeeper_GetRunningTimeRank();
-            int tRank = ScoreKeeper_GetTotalTimeRank();
-            int pRank = ScoreKeeper_GetPenaltyRank();
-
-            if (-1 < rRank) { sprintf(r, "#%d", rRank); }
-            if (-1 < tRank) { sprintf(t, "#%d", rRank); }
-            if (-1 < pRank) { sprintf(p, "#%d", rRank); }
-
-            hd44780fw_write_len(&fw_conf, r, 6, 4, HD44780FW_WR_NO_CLEAR_BEFORE);
-            hd44780fw_write_len(&fw_conf, t, 6, 20, HD44780FW_WR_NO_CLEAR_BEFORE);
-            hd44780fw_write_len(&fw_conf, p, 5, 27, HD44780FW_WR_NO_CLEAR_BEFORE);
-
-            scoreToggle = true;
-        }
+        scoreToggle = false;
+        DisplayRun();
+    }
+    else
+    {
+        char r[7] = "NONE  ";
+        char t[7] = "NONE  ";
+        char p[6] = "NONE ";
+        int rRank = ScoreKeeper_GetRunningTimeRank();
+        int tRank = ScoreKeeper_GetTotalTimeRank();
+        int pRank = ScoreKeeper_GetPenaltyRank();
+
+        if (-1 < rRank) { BuildRankString(r, rRank); }
+        if (-1 < tRank) { BuildRankString(t, rRank); }
+        if (-1 < pRank) { BuildRankString(p, rRank); }
+
+        hd44780fw_write_len(&fw_conf, r, 6, 4, HD44780FW_WR_NO_CLEAR_BEFORE);
+        hd44780fw_write_len(&fw_conf, t, 6, 20, HD44780FW_WR_NO_CLEAR_BEFORE);
+        hd44780fw_write_len(&fw_conf, p, 5, 27, HD44780FW_WR_NO_CLEAR_BEFORE);
+
+        scoreToggle = true;
     }
 }
 
-static void HandleTransistion(void)
+/**
+ * @brief Clears and resets the display for a new controller state
+ *
+ * @param currentState The new controller state
+ */
+static void HandleTransistion(controller_state_t currentState)
 {
-    const controller_state_t currentState = Controller_GetState();
+    state = currentState;
 
-    /* Only clear and reset the display on a transition */
-    if (currentState != state)
+    switch(state)
     {
-        uint8_t i;
-
-        state = currentState;
-
-        switch(state)
-        {
-        case STATE_INITIALIZE:
-            hd44780fw_write(&fw_conf, "Visual BuzzWire", 0, HD44780FW_WR_CLEAR_BEFORE);
-            hd44780fw_write(&fw_conf, "Version 1.0.00", 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-            break;
-        case STATE_WAITING:
-            for (i = 0; i < 8; i++)
-            {
-                hd44780fw_build_cc(&fw_conf, i, leftArrows[i]);
-            }
-
-            hd44780fw_write_len(&fw_conf, leftArrowline[0], 16, 0, HD44780FW_WR_CLEAR_BEFORE);
-            hd44780fw_write_len(&fw_conf, startInstructions, 16, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-            arrowIndex = 0;
-            idx = 0;
-            instructionIndex = 0;
-            Timer_Reset(&quickTimer);
-            Timer_Reset(&mediumTimer);
-            break;
-        case STATE_BEGIN:
-            for (i = 0; i < 8; i++)
-            {
-                hd44780fw_build_cc(&fw_conf, i, rightArrows[i]);
-            }
-
-            hd44780fw_write_len(&fw_conf, rightArrowline[0], 16, 0, HD44780FW_WR_CLEAR_BEFORE);
-            hd44780fw_write_len(&fw_conf, winInstructions, 16, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-            arrowIndex = 0;
-            idx = 0;
-            instructionIndex = 0;
-            Timer_Reset(&quickTimer);
-            Timer_Reset(&mediumTimer);
-            break;
-        case STATE_RUNNING:
-            hd44780fw_write(&fw_conf, "RUN    0.0 TOUCH", 0, HD44780FW_WR_CLEAR_BEFORE);
-            hd44780fw_write(&fw_conf, "TOT    0.0     0", 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-            break;
-        case STATE_BUZZ:
-            hd44780fw_build_cc(&fw_conf, 0, antiasterik);
-            hd44780fw_write_len(&fw_conf, buzzline[0], 16, 0, HD44780FW_WR_CLEAR_BEFORE);
-            hd44780fw_write_len(&fw_conf, buzzline[1], 16, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-            break;
-        case STATE_DONE:
-            /* Force the medium timer to expire so that it'll display the score */
-            mediumTimer.remaining = 0;
-            Timer_Reset(&slowTimer);
-
-            hd44780fw_write(&fw_conf, "RUN    0.0 TOUCH", 0, HD44780FW_WR_CLEAR_BEFORE);
-            hd44780fw_write(&fw_conf, "TOT    0.0     0", 16, HD44780FW_WR_NO_CLEAR_BEFORE);
-            DisplayRun();
-            scoreToggle = false;
-            break;
-        default:
-            /* do nothing */
-            break;
-        }
+    case STATE_INITIALIZE:
+        hd44780fw_write_P(&fw_conf, PSTR("Visual BuzzWire"), 0, HD44780FW_WR_CLEAR_BEFORE);
+        hd44780fw_write_P(&fw_conf, PSTR("Version 1.0.00"), 16, HD44780FW_WR_NO_CLEAR_BEFORE);
+        break;
+    case STATE_WAITING:
+        hd44780fw_build_ccs_P(&fw_conf, 0, 8, leftArrows[0]);
+
+        hd44780fw_write_len_P(&fw_conf, leftArrowline[0], 16, 0, HD44780FW_WR_CLEAR_BEFORE);
+        hd44780fw_marquee_P(&fw_conf, startInstructions, sizeof(startInstructions) - 1, 1);
+        arrowIndex = 0;
+        idx = 0;
+        Timer_Reset(&quickTimer);
+        Timer_Reset(&mediumTimer);
+        break;
+    case STATE_BEGIN:
+        hd44780fw_build_ccs_P(&fw_conf, 0, 8, rightArrows[0]);
+
+        hd44780fw_write_len_P(&fw_conf, rightArrowline[0], 16, 0, HD44780FW_WR_CLEAR_BEFORE);
+        hd44780fw_marquee_P(&fw_conf, winInstructions, sizeof(winInstructions) - 1, 1);
+        arrowIndex = 0;
+        idx = 0;
+        Timer_Reset(&quickTimer);
+        Timer_Reset(&mediumTimer);
+        break;
+    case STATE_RUNNING:
+        hd44780fw_write_P(&fw_conf, runLine, 0, HD44780FW_WR_CLEAR_BEFORE);
+        hd44780fw_write_P(&fw_conf, totalLine, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
+        DisplayRun();
+        break;
+    case STATE_BUZZ:
+        hd44780fw_clear(&fw_conf);
+        buzzGlyph = hd44780fw_get_cc_P(&fw_conf, antiasterik);
+        WriteBuzzLine(buzzline[0], 0);
+        WriteBuzzLine(buzzline[1], 16);
+        break;
+    case STATE_DONE:
+        Timer_Reset(&slowTimer);
+
+        hd44780fw_write_P(&fw_conf, runLine, 0, HD44780FW_WR_CLEAR_BEFORE);
+        hd44780fw_write_P(&fw_conf, totalLine, 16, HD44780FW_WR_NO_CLEAR_BEFORE);
+        DisplayRun();
+        scoreToggle = false;
+        break;
+    default:
+        /* do nothing */
+        break;
     }
 }
 
-static void HandleState(void)
+/**
+ * @brief Animates the display every quick period
+ *
+ * @param context Unused
+ */
+static void QuickTimeout(void *context)
 {
-
     switch(state)
     {
-    case STATE_INITIALIZE: /* do nothing */ break;
     case STATE_WAITING:    DisplayWait();   break;
     case STATE_BEGIN:      DisplayBegin();  break;
     case STATE_RUNNING:    DisplayRun();    break;
     case STATE_BUZZ:       DisplayBuzz();   break;
-    case STATE_DONE:       DisplayScore();  break;
     default:               /* do nothing */ break;
     }
 }
 
+/**
+ * @brief Scrolls the instructions every medium period
+ *
+ * @param context Unused
+ */
+static void MediumTimeout(void *context)
+{
+    if ((STATE_WAITING == state) || (STATE_BEGIN == state))
+    {
+        hd44780fw_marquee_step(&fw_conf);
+    }
+}
+
+/**
+ * @brief Alternates the score and the ranks every slow period
+ *
+ * @param context Unused
+ */
+static void SlowTimeout(void *context)
+{
+    if (STATE_DONE == state)
+    {
+        DisplayScore();
+    }
+}
+
 void Display_Initialize(void)
 {
     state = (controller_state_t)0xFF;
@@ -347,23 +398,28 @@ void Display_Initialize(void)
     Timer_Initialize(&mediumTimer, TIMER_MODE_RECURRING, 300);
     Timer_Initialize(&slowTimer, TIMER_MODE_RECURRING, 1000);
 
+    Timer_SetCallback(&quickTimer, QuickTimeout, NULL);
+    Timer_SetCallback(&mediumTimer, MediumTimeout, NULL);
+    Timer_SetCallback(&slowTimer, SlowTimeout, NULL);
+
     BSP_ConfigureDisplay(&low_conf);
+    BSP_ConfigureDisplayQueue(&fw_conf);
 
 	fw_conf.low_conf = &low_conf;
 	low_conf.line1_base_addr = 0x00;
 	low_conf.line2_base_addr = 0x40;
-	low_conf.dl = HD44780_L_FS_DL_8BIT;
 
 	fw_conf.total_chars = 32;
 	fw_conf.font = HD44780_L_FS_F_58;
 	fw_conf.lines = HD44780_L_FS_N_DUAL;
 
 	hd44780fw_init(&fw_conf);
+
+    (void)Controller_Subscribe(HandleTransistion);
 }
 
 void Display_Run(void)
 {
-    HandleTransistion();
-    HandleState();
+    hd44780fw_flush(&fw_conf);
 }
 
@@ -27,7 +27,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 void Display_Initialize(void);
 
 /**
- * @brief Executes the display
+ * @brief Sends the pending changes to the display
+ *
+ * The content follows the controller state, it is updated by the
+ * controller and the timer service
  */
 void Display_Run(void);
 
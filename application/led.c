@@ -16,6 +16,8 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stddef.h>
+
 #include "common/bsp_interface.h"
 #include "common/timers.h"
 
@@ -28,6 +30,10 @@ static timer_t subTimer;
 
 static controller_state_t state;
 
+/* Whether the LEDs are toggling in the waiting state, they toggle for 1 */
+/* second then stay off for 4, with the toggle timer stopped             */
+static bool subToggle;
+
 /**
  * @brief Toggles the LEDs
  */
@@ -35,20 +41,17 @@ static void Toggle(void)
 {
     static bool toggle = false;
 
-    if (Timer_Timeout(&timer))
+    if (toggle)
+    {
+        toggle = false;
+        BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP0, false);
+        BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP1, true);
+    }
+    else
     {
-        if (toggle)
-        {
-            toggle = false;
-            BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP0, false);
-            BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP1, true);
-        }
-        else
-        {
-            toggle = true;
-            BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP1, false);
-            BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP0, true);
-        }
+        toggle = true;
+        BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP1, false);
+        BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP0, true);
     }
 }
 
@@ -61,91 +64,97 @@ static void Off(void)
     BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP1, false);
 }
 
-static void HandleTransistion(void)
+/**
+ * @brief Sets the LEDs up for a new controller state
+ *
+ * @param currentState The new controller state
+ */
+static void HandleTransistion(controller_state_t currentState)
 {
-    const controller_state_t currentState = Controller_GetState();
+    state = currentState;
 
-    if (state != currentState)
-    {
-        state = currentState;
-
-        switch(state)
-        {
-        case STATE_INITIALIZE:
-            Timer_SetTimeoutPeriod(&timer, 200);
-            break;
-        case STATE_DONE:
-        case STATE_BEGIN:
-            Timer_SetTimeoutPeriod(&timer, 300);
-            break;
-        case STATE_BUZZ:
-            Timer_SetTimeoutPeriod(&timer, 50);
-            break;
-        case STATE_WAITING:
-            Timer_SetTimeoutPeriod(&subTimer, 1000);
-            Timer_SetTimeoutPeriod(&timer, 10);
-            break;
-        case STATE_RUNNING:
-        default:
-            /* do nothing */
-            break;
-        }
+    /* A period of 0 stops a timer, the states that do not flash the */
+    /* LEDs leave nothing for the timer service to do                 */
+    Timer_SetTimeoutPeriod(&subTimer, 0);
 
-        Off();
-        Timer_Reset(&timer);
+    switch(state)
+    {
+    case STATE_INITIALIZE:
+        Timer_SetTimeoutPeriod(&timer, 200);
+        break;
+    case STATE_DONE:
+    case STATE_BEGIN:
+        Timer_SetTimeoutPeriod(&timer, 300);
+        break;
+    case STATE_BUZZ:
+        Timer_SetTimeoutPeriod(&timer, 50);
+        break;
+    case STATE_WAITING:
+        Timer_SetTimeoutPeriod(&subTimer, 1000);
+        Timer_SetTimeoutPeriod(&timer, subToggle ? 10 : 0);
+        break;
+    case STATE_RUNNING:
+    default:
+        Timer_SetTimeoutPeriod(&timer, 0);
+        break;
     }
+
+    Off();
 }
 
-static void HandleState(void)
+/**
+ * @brief Toggles the LEDs every period of the timer, in the states that
+ *        flash them
+ *
+ * The period is set during the handling of the state transition
+ *
+ * @param context Unused
+ */
+static void ToggleTimeout(void *context)
 {
-    static bool subToggle = false;
-
-    /* The period of the timer used for toggling the LEDs */
-    /* is set during the handling of the state transition */
     switch(state)
     {
     case STATE_INITIALIZE:
     case STATE_BUZZ:
     case STATE_DONE:
     case STATE_BEGIN:
-        Toggle();
-        break;
     case STATE_WAITING:
-        /* Off for 4 seconds, then toggle for 1 second */
-        if (subToggle)
-        {
-            if (Timer_Timeout(&subTimer))
-            {
-                subToggle = false;
-                Timer_SetTimeoutPeriod(&subTimer, 4000);
-            }
-            else
-            {
-                Toggle();
-            }
-        }
-        else
-        {
-            if (Timer_Timeout(&subTimer))
-            {
-                subToggle = true;
-                Timer_SetTimeoutPeriod(&subTimer, 1000);
-                Timer_Reset(&timer);
-            }
-            else
-            {
-                Off();
-            }
-        }
+        Toggle();
         break;
     case STATE_RUNNING:
     default:
-        /* Everything off */
-        Off();
+        /* Everything stays off */
         break;
     }
 }
 
+/**
+ * @brief Alternates the waiting state between toggling and off
+ *
+ * @param context Unused
+ */
+static void WaitingTimeout(void *context)
+{
+    if (STATE_WAITING != state)
+    {
+        return;
+    }
+
+    if (subToggle)
+    {
+        subToggle = false;
+        Timer_SetTimeoutPeriod(&subTimer, 4000);
+        Timer_SetTimeoutPeriod(&timer, 0);
+        Off();
+    }
+    else
+    {
+        subToggle = true;
+        Timer_SetTimeoutPeriod(&subTimer, 1000);
+        Timer_SetTimeoutPeriod(&timer, 10);
+    }
+}
+
 void LED_Initialize(void)
 {
     state = (controller_state_t)0xFF;
@@ -153,13 +162,11 @@ void LED_Initialize(void)
     BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP0, false);
     BSPInterface_SetOutputState(BSP_OUTPUT_LED_GROUP1, false);
 
-    Timer_Initialize(&timer, TIMER_MODE_RECURRING, 50);
     Timer_Initialize(&timer, TIMER_MODE_RECURRING, 10);
-}
+    Timer_Initialize(&subTimer, TIMER_MODE_SINGLE, 0);
 
-void LED_Run(void)
-{
-    HandleTransistion();
-    HandleState();
-}
+    Timer_SetCallback(&timer, ToggleTimeout, NULL);
+    Timer_SetCallback(&subTimer, WaitingTimeout, NULL);
 
+    (void)Controller_Subscribe(HandleTransistion);
+}
@@ -22,13 +22,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 /**
  * @brief Sets up the LEDs
+ *
+ * The LEDs follow the controller state from then on, driven by the
+ * controller and the timer service
  */
 void LED_Initialize(void);
 
-/**
- * @brief Executes the LEDs
- */
-void LED_Run(void);
-
 #endif /* __BUZZWIRE_CONTROLLER_H__ */
 
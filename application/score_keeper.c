@@ -19,30 +19,111 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "score_keeper.h"
 
+#include <stddef.h>
+#include <util/crc16.h>
+
+#include "common/bsp_interface.h"
+#include "common/frame.h"
 #include "common/timers.h"
 
 #define PENALTY_TIME 500
 #define NUMBER_OF_RECORDS_TO_RETAIN 10
 
+/*
+ * The leaderboard is kept in the EEPROM as rotated copies, each save goes
+ * to the slot after the last one so the wear is spread over all of them.
+ * At boot, the newest copy whose CRC checks out is loaded
+ */
+#define LEADERBOARD_ADDRESS 0
+#define LEADERBOARD_SLOTS   16
+
+/* Time between attempts to save while a save is still being written */
+#define SAVE_RETRY_TIME 100
+
+/* An empty record in the EEPROM, as the EEPROM reads when erased */
+#define EMPTY_RECORD 0xFFFFFFFFUL
+
+/* The sequence of a slot that was never written */
+#define ERASED_SEQUENCE 0xFFFF
+
 typedef struct
 {
     uint32_t record;
     bool valid;
 } record_t;
 
+/**
+ * @brief A copy of the leaderboard in the EEPROM
+ */
+typedef struct
+{
+    uint32_t running[NUMBER_OF_RECORDS_TO_RETAIN];
+    uint32_t penalty[NUMBER_OF_RECORDS_TO_RETAIN];
+    uint32_t total[NUMBER_OF_RECORDS_TO_RETAIN];
+    uint16_t crc;       //!< Of the records and the sequence
+    uint16_t sequence;  //!< Counts the saves.  Last in the slot, so it is
+                        //!< written last and a torn save fails the CRC
+} leaderboard_t;
+
+typedef char leaderboard_slots_fit[(LEADERBOARD_SLOTS <= 32) ? 1 : -1];
+
 static record_t top_running[NUMBER_OF_RECORDS_TO_RETAIN];
 static record_t top_penalty[NUMBER_OF_RECORDS_TO_RETAIN];
 static record_t top_total[NUMBER_OF_RECORDS_TO_RETAIN];
 
-static stopwatch_t sw;
+/* The copy being saved, it is left alone until the write is done */
+static leaderboard_t leaderboard;
+static uint8_t nextSlot;
+static uint16_t nextSequence;
+static bool savePending;
+static timer_t saveTimer;
+
+static bsp_timestamp_t startTime;
+static bsp_timestamp_t endTime;
+static bool running;
 static score_t score;
 
+static score_clock_t gameClock;
+static uint32_t clockRunningTime;
+static uint32_t clockPenalties;
+
+/**
+ * @brief Gets the number of whole milliseconds between two times
+ *
+ * @param from The earlier time
+ * @param to The later time
+ *
+ * @return milliseconds, 0 if to is not later than from
+ */
+static uint32_t ElapsedTime(const bsp_timestamp_t *from, const bsp_timestamp_t *to)
+{
+    uint32_t elapsed = to->ticks - from->ticks;
+
+    if ((int32_t)elapsed < 0)
+    {
+        return 0;
+    }
+
+    /* Borrow a millisecond if the microseconds wrapped */
+    if (to->us < from->us)
+    {
+        if (0 == elapsed)
+        {
+            return 0;
+        }
+
+        elapsed--;
+    }
+
+    return elapsed;
+}
+
 /**
  * @brief updates the record list
  *
  * If the given record is lower than any of the existing records, it is
- * inserted in the list.  If it is equal, then it will be replicated,
- * the record list holds no duplicates.
+ * inserted in the list.  If it is equal to one, the list is left as it
+ * is, the record list holds no duplicates.
  *
  * If the record list has not been completely populated, and the record
  * does not beat any of the valid records, it is put at the end of the
@@ -50,8 +131,10 @@ static score_t score;
  *
  * @param recordList Pointer to array of records to update
  * @param record The record to attempt to insert
+ *
+ * @return true if the list changed
  */
-static void UpdateRecord(record_t *recordList, uint32_t record)
+static bool UpdateRecord(record_t *recordList, uint32_t record)
 {
     uint8_t i;
     uint8_t j;
@@ -63,22 +146,29 @@ static void UpdateRecord(record_t *recordList, uint32_t record)
         {
             recordList[i].valid = true;
             recordList[i].record = record;
+            return true;
         }
-        else if (recordList[i].record >= record)
+
+        /* if it's a tie, don't duplicate it */
+        if (recordList[i].record == record)
         {
-            /* if it's a tie, don't duplicate it */
-            uint8_t firstRecordToShift = (recordList[i].record == record ? i + 1 : i);
+            return false;
+        }
 
-            /* Shift the other records down */
-            for (j = NUMBER_OF_RECORDS_TO_RETAIN - 2; j >= firstRecordToShift; j--)
+        if (recordList[i].record > record)
+        {
+            /* Shift the other records down, the last one drops off */
+            for (j = NUMBER_OF_RECORDS_TO_RETAIN - 1; j > i; j--)
             {
-                recordList[j + 1] = recordList[j];
+                recordList[j] = recordList[j - 1];
             }
 
             recordList[i].record = record;
-            break;
+            return true;
         }
     }
+
+    return false;
 }
 
 /**
@@ -108,11 +198,216 @@ static int GetRank(record_t *recordList, uint32_t record)
     return rank;
 }
 
+/**
+ * @brief Gets the storage address of a leaderboard slot
+ */
+static uint16_t SlotAddress(uint8_t slot)
+{
+    return LEADERBOARD_ADDRESS + (slot * sizeof(leaderboard_t));
+}
+
+/**
+ * @brief Checks if a save comes after another
+ *
+ * The sequences of the slots are at most LEADERBOARD_SLOTS apart, so they
+ * compare across the wrap
+ *
+ * @return true if a is newer than b
+ */
+static bool Newer(uint16_t a, uint16_t b)
+{
+    return 0 < (int16_t)(a - b);
+}
+
+/**
+ * @brief Computes the CRC of a leaderboard copy
+ *
+ * @param board The copy
+ *
+ * @return CRC of the records and the sequence
+ */
+static uint16_t Checksum(const leaderboard_t *board)
+{
+    const uint8_t *bytes = (const uint8_t *)board;
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    for (i = 0; i < offsetof(leaderboard_t, crc); i++)
+    {
+        crc = _crc16_update(crc, bytes[i]);
+    }
+
+    crc = _crc16_update(crc, (uint8_t)board->sequence);
+    crc = _crc16_update(crc, (uint8_t)(board->sequence >> 8));
+
+    return crc;
+}
+
+/**
+ * @brief Copies a record list into a leaderboard copy
+ *
+ * @param to The records of the copy, EMPTY_RECORD for the invalid ones
+ * @param from The record list
+ */
+static void PackRecords(uint32_t *to, const record_t *from)
+{
+    uint8_t i;
+
+    for (i = 0; i < NUMBER_OF_RECORDS_TO_RETAIN; i++)
+    {
+        to[i] = from[i].valid ? from[i].record : EMPTY_RECORD;
+    }
+}
+
+/**
+ * @brief Copies the records of a leaderboard copy into a record list
+ *
+ * @param to The record list
+ * @param from The records of the copy
+ */
+static void UnpackRecords(record_t *to, const uint32_t *from)
+{
+    uint8_t i;
+
+    for (i = 0; i < NUMBER_OF_RECORDS_TO_RETAIN; i++)
+    {
+        to[i].valid = (EMPTY_RECORD != from[i]);
+        to[i].record = from[i];
+    }
+}
+
+/**
+ * @brief Loads the newest leaderboard copy that is intact
+ *
+ * Only the sequences are read to find the newest copy, so it normally
+ * takes one copy read.  A copy that fails its CRC, like a save that was
+ * cut off by a power loss, is passed over for the one before it, so at
+ * worst every slot is read once
+ *
+ * @return true if a copy was loaded
+ */
+static bool LoadLeaderboard(void)
+{
+    uint16_t sequences[LEADERBOARD_SLOTS];
+    uint32_t rejected = 0;
+    uint8_t slot;
+
+    for (slot = 0; slot < LEADERBOARD_SLOTS; slot++)
+    {
+        BSPInterface_ReadStorage(SlotAddress(slot) + offsetof(leaderboard_t, sequence),
+                                 &sequences[slot], sizeof(uint16_t));
+
+        if (ERASED_SEQUENCE == sequences[slot])
+        {
+            rejected |= 1UL << slot;
+        }
+    }
+
+    for (;;)
+    {
+        uint8_t newest = LEADERBOARD_SLOTS;
+
+        for (slot = 0; slot < LEADERBOARD_SLOTS; slot++)
+        {
+            if ((0 == (rejected & (1UL << slot))) &&
+                ((LEADERBOARD_SLOTS == newest) || Newer(sequences[slot], sequences[newest])))
+            {
+                newest = slot;
+            }
+        }
+
+        if (LEADERBOARD_SLOTS == newest)
+        {
+            return false;
+        }
+
+        BSPInterface_ReadStorage(SlotAddress(newest), &leaderboard, sizeof(leaderboard_t));
+
+        if (Checksum(&leaderboard) == leaderboard.crc)
+        {
+            UnpackRecords(top_running, leaderboard.running);
+            UnpackRecords(top_penalty, leaderboard.penalty);
+            UnpackRecords(top_total, leaderboard.total);
+
+            /* Carry on after it, over any copy that failed */
+            nextSlot = (newest + 1) % LEADERBOARD_SLOTS;
+            nextSequence = leaderboard.sequence + 1;
+            return true;
+        }
+
+        rejected |= 1UL << newest;
+    }
+}
+
+/**
+ * @brief Starts saving the leaderboard to the next slot
+ *
+ * The save is written in the background.  If the last one is still being
+ * written, this is tried again later
+ */
+static void SaveLeaderboard(void)
+{
+    savePending = true;
+
+    if (BSPInterface_StorageBusy())
+    {
+        Timer_Reset(&saveTimer);
+        return;
+    }
+
+    PackRecords(leaderboard.running, top_running);
+    PackRecords(leaderboard.penalty, top_penalty);
+    PackRecords(leaderboard.total, top_total);
+
+    /* An erased slot is never taken for a save */
+    if (ERASED_SEQUENCE == nextSequence)
+    {
+        nextSequence++;
+    }
+
+    leaderboard.sequence = nextSequence;
+    leaderboard.crc = Checksum(&leaderboard);
+
+    if (BSPInterface_WriteStorage(SlotAddress(nextSlot), &leaderboard, sizeof(leaderboard_t)))
+    {
+        nextSlot = (nextSlot + 1) % LEADERBOARD_SLOTS;
+        nextSequence++;
+        savePending = false;
+    }
+}
+
+/**
+ * @brief Tries the save again
+ *
+ * @param context Unused
+ */
+static void SaveTimeout(void *context)
+{
+    if (savePending)
+    {
+        SaveLeaderboard();
+    }
+}
+
 void ScoreKeeper_Initialize(void)
 {
     uint8_t i;
 
     score.valid = false;
+    running = false;
+
+    Timer_Initialize(&saveTimer, TIMER_MODE_SINGLE, SAVE_RETRY_TIME);
+    Timer_SetCallback(&saveTimer, SaveTimeout, NULL);
+    savePending = false;
+
+    if (LoadLeaderboard())
+    {
+        return;
+    }
+
+    /* Nothing saved yet, or nothing intact, start a new leaderboard */
+    nextSlot = 0;
+    nextSequence = 0;
 
     for (i = 0; i < NUMBER_OF_RECORDS_TO_RETAIN; i++)
     {
@@ -122,13 +417,19 @@ void ScoreKeeper_Initialize(void)
     }
 }
 
-void ScoreKeeper_Start(void)
+void ScoreKeeper_Start(const bsp_timestamp_t *start)
 {
-    Stopwatch_Initialize(&sw);
+    startTime = *start;
+    running = true;
     score.penalties = 0;
     score.runningTime = 0;
     score.totalTime = 0;
     score.valid = true;
+
+    BcdTime_Reset(&gameClock.runningTime);
+    BcdTime_Reset(&gameClock.totalTime);
+    clockRunningTime = 0;
+    clockPenalties = 0;
 }
 
 void ScoreKeeper_Penalty(void)
@@ -136,29 +437,71 @@ void ScoreKeeper_Penalty(void)
     score.penalties++;
 }
 
-void ScoreKeeper_End(void)
+void ScoreKeeper_End(const bsp_timestamp_t *end)
 {
-    Stopwatch_Stop(&sw);
+    endTime = *end;
+    running = false;
 
     /* Get a local copy so that the total time is accurate */
     const score_t local = ScoreKeeper_GetScore();
 
+    bool changed;
+
     /* Update the records */
-    UpdateRecord(top_penalty, local.penalties);
+    changed = UpdateRecord(top_penalty, local.penalties);
 
     /* The times are truncated to the nearest tenth of a second */
-    UpdateRecord(top_running, (local.runningTime - (local.runningTime % 100)));
-    UpdateRecord(top_total, (local.totalTime - (local.totalTime % 100)));
+    changed |= UpdateRecord(top_running, (local.runningTime - (local.runningTime % 100)));
+    changed |= UpdateRecord(top_total, (local.totalTime - (local.totalTime % 100)));
+
+    /* Keep the leaderboard over a power cycle */
+    if (changed)
+    {
+        SaveLeaderboard();
+    }
 }
 
 const score_t ScoreKeeper_GetScore(void)
 {
-    score.runningTime = Stopwatch_GetElapsed(&sw);
+    /* A game in progress is scored as of the frame, so the score agrees */
+    /* with the inputs and the timers                                      */
+    if (running)
+    {
+        Frame_GetTimestamp(&endTime);
+    }
+
+    score.runningTime = ElapsedTime(&startTime, &endTime);
     score.totalTime = score.runningTime + score.penalties * PENALTY_TIME;
 
     return score;
 }
 
+const score_clock_t ScoreKeeper_GetClock(void)
+{
+    const score_t local = ScoreKeeper_GetScore();
+    uint32_t elapsed;
+
+    /* The end of a game can be dated before the last reading, so the time */
+    /* can go back: rebuild the counters from the whole time then          */
+    if (local.runningTime < clockRunningTime)
+    {
+        BcdTime_Reset(&gameClock.runningTime);
+        BcdTime_Reset(&gameClock.totalTime);
+        clockRunningTime = 0;
+        clockPenalties = 0;
+    }
+
+    elapsed = local.runningTime - clockRunningTime;
+
+    BcdTime_Add(&gameClock.runningTime, elapsed);
+    BcdTime_Add(&gameClock.totalTime, elapsed + (local.penalties - clockPenalties) * PENALTY_TIME);
+
+    clockRunningTime = local.runningTime;
+    clockPenalties = local.penalties;
+
+    return gameClock;
+}
+
 const score_t ScoreKeeper_GetLastScore(void)
 {
     return score;
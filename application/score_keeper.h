@@ -22,6 +22,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "common/bcd_time.h"
+#include "common/bsp_interface.h"
+
 typedef struct
 {
     uint32_t runningTime;
@@ -30,6 +33,12 @@ typedef struct
     bool valid;
 } score_t;
 
+typedef struct
+{
+    bcd_time_t runningTime;
+    bcd_time_t totalTime;
+} score_clock_t;
+
 /**
  * @brief Sets up the scoring system
  */
@@ -37,8 +46,10 @@ void ScoreKeeper_Initialize(void);
 
 /**
  * @brief Starts a game
+ *
+ * @param start Time the game started at
  */
-void ScoreKeeper_Start(void);
+void ScoreKeeper_Start(const bsp_timestamp_t *start);
 
 /**
  * @brief Count a penalty
@@ -47,8 +58,13 @@ void ScoreKeeper_Penalty(void);
 
 /**
  * @brief Ends a game
+ *
+ * The end is the time of the contact, which can be before the frame that
+ * handles it, and so before the last reading of the clock
+ *
+ * @param end Time the game ended at
  */
-void ScoreKeeper_End(void);
+void ScoreKeeper_End(const bsp_timestamp_t *end);
 
 /**
  * @brief Gets the score for the current game
@@ -58,6 +74,18 @@ void ScoreKeeper_End(void);
  */
 const score_t ScoreKeeper_GetScore(void);
 
+/**
+ * @brief Gets the times of the current game as BCD counters
+ *
+ * The counters are advanced by the time elapsed since the last call,
+ * rather than rebuilt from the millisecond counts, unless the time went
+ * back since then
+ *
+ * If there is no game running, this obtains the last completed times
+ * @return clock
+ */
+const score_clock_t ScoreKeeper_GetClock(void);
+
 /**
  * @brief Gets the score for the last completed game
  *
@@ -19,11 +19,263 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "bsp.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "common/bsp_interface.h"
+#include "common/ring.h"
 
 #include "timers.h"
 
+static struct hd44780fw_conf *queuedDisplay;
+
+/* Display queue service period, in Timer2 counts at Clk_io / 64.  Each */
+/* service sends a few bytes, so it takes a few hundred cycles: a much  */
+/* shorter period would starve the main loop and the lower priority     */
+/* tick interrupt                                                       */
+#define DISPLAY_QUEUE_COUNTS ((F_CPU / 1000UL) * HD44780FW_Q_TICK_US / 64000UL)
+
+typedef char display_queue_fits_timer[
+    ((1 <= DISPLAY_QUEUE_COUNTS) && (DISPLAY_QUEUE_COUNTS <= 256)) ? 1 : -1];
+
+/* Input changes, pushed by the input filter */
+#define INPUT_QUEUE_SIZE 16
+
+static bsp_input_event_t inputEvents[INPUT_QUEUE_SIZE];
+static ring_t inputQueue;
+
+/* Told about queued events.  The pointer is only used while the flag is */
+/* set, the flag is a byte so the interrupt sees it change at once        */
+static volatile bsp_input_listener_t inputListener;
+static volatile bool inputListening;
+
+/* Block being written to the EEPROM, by the EE_READY interrupt */
+static const uint8_t * volatile storageData;
+static volatile uint16_t storageAddress;
+static volatile uint16_t storageLength;
+
+/**
+ * @brief Input filter settings, @see BSP_WIRE_CONTACT_MS
+ */
+typedef struct
+{
+    uint8_t contact;  //!< ms a contact must outweigh its absence to be reported
+    uint8_t release;  //!< ms its absence must outweigh it for the end to be
+                      //!< reported
+} input_filter_t;
+
+static const input_filter_t inputFilters[BSP_NUMBER_OF_INPUTS] =
+{
+    { BSP_LEFT_POST_CONTACT_MS,  BSP_LEFT_POST_RELEASE_MS  },
+    { BSP_RIGHT_POST_CONTACT_MS, BSP_RIGHT_POST_RELEASE_MS },
+    { BSP_WIRE_CONTACT_MS,       BSP_WIRE_RELEASE_MS       }
+};
+
+/**
+ * @brief Filter state of an input
+ */
+typedef struct
+{
+    bool state;              //!< Filtered logic state
+    bool sensed;             //!< A contact was caught by the external
+                             //!< interrupt since the last sample
+    bool timed;              //!< The start of the change was timed
+    uint8_t count;           //!< Integrator, ms toward changing state
+    bsp_timestamp_t change;  //!< When the change started
+} input_t;
+
+static volatile input_t inputs[BSP_NUMBER_OF_INPUTS];
+
+/**
+ * @brief Reads the present level of an input line
+ *
+ * @param id The input
+ *
+ * @return true if the line senses a contact
+ */
+static bool ReadInput(bsp_inputs_t id)
+{
+    bool contact = false;
+
+    /* the buzz inputs are active low */
+    switch (id)
+    {
+    case BSP_INPUT_BUZZ_LEFT_POST:
+        contact = !(PINB & _BV(2));
+        break;
+    case BSP_INPUT_BUZZ_RIGHT_POST:
+        contact = !(PIND & _BV(3));
+        break;
+    case BSP_INPUT_BUZZ_WIRE:
+        contact = !(PIND & _BV(2));
+        break;
+    default:
+        /* do nothing */
+        break;
+    }
+
+    return contact;
+}
+
+/**
+ * @brief Records an edge of an input, from its external interrupt
+ *
+ * A contact counts for the next sample even if it is gone by then, so
+ * contacts shorter than the tick are not lost
+ *
+ * @param id The input
+ * @param contact true if the edge starts a contact
+ */
+static void InputEdge(bsp_inputs_t id, bool contact)
+{
+    volatile input_t *input = &inputs[id];
+    bsp_timestamp_t now;
+
+    if (contact)
+    {
+        input->sensed = true;
+    }
+
+    /* Time the change from its first edge, not from the sample that */
+    /* sees it                                                       */
+    if ((contact != input->state) && !input->timed)
+    {
+        BSPInterface_GetTimestamp(&now);
+        input->change = now;
+        input->timed = true;
+    }
+}
+
+/**
+ * @brief Runs the filter of an input for one tick
+ *
+ * @param id The input
+ */
+static void SampleInput(bsp_inputs_t id)
+{
+    volatile input_t *input = &inputs[id];
+    bool contact = ReadInput(id) || input->sensed;
+    bsp_input_event_t event;
+    bsp_timestamp_t now;
+    uint8_t limit;
+
+    input->sensed = false;
+
+    if (contact == input->state)
+    {
+        /* Integrate back, a change that dies out is not reported */
+        if (0 < input->count)
+        {
+            input->count--;
+        }
+
+        if (0 == input->count)
+        {
+            input->timed = false;
+        }
+
+        return;
+    }
+
+    if (!input->timed)
+    {
+        BSPInterface_GetTimestamp(&now);
+        input->change = now;
+        input->timed = true;
+    }
+
+    limit = input->state ? inputFilters[id].release : inputFilters[id].contact;
+
+    if (++input->count < limit)
+    {
+        return;
+    }
+
+    input->state = contact;
+    input->count = 0;
+    input->timed = false;
+
+    event.id = id;
+    event.state = contact;
+    event.timestamp = input->change;
+
+    /* Dropped if the main loop is stalled for a whole queue of changes */
+    if (Ring_Push(&inputQueue, &event) && inputListening)
+    {
+        inputListener();
+    }
+}
+
+void BSP_SampleInputs(void)
+{
+    uint8_t id;
+
+    for (id = 0; id < BSP_NUMBER_OF_INPUTS; id++)
+    {
+        SampleInput((bsp_inputs_t)id);
+    }
+}
+
+/* Buzz wire touched */
+ISR(INT0_vect)
+{
+    InputEdge(BSP_INPUT_BUZZ_WIRE, true);
+}
+
+/* Right post touched */
+ISR(INT1_vect)
+{
+    InputEdge(BSP_INPUT_BUZZ_RIGHT_POST, true);
+}
+
+/* Left post touched or left, the game starts when it is left */
+ISR(INT2_vect)
+{
+    InputEdge(BSP_INPUT_BUZZ_LEFT_POST, ReadInput(BSP_INPUT_BUZZ_LEFT_POST));
+}
+
+/* EEPROM ready for the next byte, for as long as it is enabled */
+ISR(EE_READY_vect)
+{
+    if (0 == storageLength)
+    {
+        EECR &= ~_BV(EERIE);
+        return;
+    }
+
+    EEAR = storageAddress++;
+    EEDR = *storageData++;
+
+    /* Erase and write, EEPE must be set within 4 cycles of EEMPE */
+    EECR |= _BV(EEMPE);
+    EECR |= _BV(EEPE);
+
+    storageLength--;
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+    /* Stop servicing the display queue once it's drained */
+    if (!hd44780fw_q_service(queuedDisplay))
+    {
+        TIMSK2 = 0x00;
+    }
+}
+
+/**
+ * @brief Starts servicing the display queue
+ */
+static void StartDisplayQueue(void)
+{
+    TIMSK2 = 0x02;
+}
+
 void BSPInterface_Initialize(void)
 {
+    uint8_t id;
+
     /* Pull up the unused pins */
     MCUSR &= 0xEF;
 
@@ -103,11 +355,24 @@ void BSPInterface_Initialize(void)
     PORTC |= 0xC3; /* Don't mess with the pins used for JTAG */
     PORTD |= 0x83; /* Don't pull up the pins that are used for ext interrupt - they're already pulled externally */
 
-    /* Interrupt on the falling edge of ext interrupts */
-    EICRA = 0x2A;
+    /* Interrupt on the falling edge of ext interrupts, and on both */
+    /* edges of INT2 to time leaving the left post                   */
+    EICRA = 0x1A;
+
+    /* The inputs start out in the state they are in, without an event */
+    Ring_Initialize(&inputQueue, inputEvents, sizeof(bsp_input_event_t), INPUT_QUEUE_SIZE);
+
+    for (id = 0; id < BSP_NUMBER_OF_INPUTS; id++)
+    {
+        inputs[id].state = ReadInput((bsp_inputs_t)id);
+        inputs[id].sensed = false;
+        inputs[id].timed = false;
+        inputs[id].count = 0;
+    }
 
-    /* Clear the external interrupt flags */
-    EIFR = 0x03;
+    /* Clear the external interrupt flags and enable the interrupts */
+    EIFR = 0x07;
+    EIMSK = 0x07;
 
     BSP_InitializeTimers();
 
@@ -117,28 +382,33 @@ void BSPInterface_Initialize(void)
 
 void BSP_ConfigureDisplay(struct hd44780_l_conf *lcdfw)
 {
-	lcdfw->rs_i = 4;
-	lcdfw->rw_i = 5;
-	lcdfw->en_i = 6;
-	lcdfw->db7_i = 7;
-	lcdfw->db6_i = 6;
-	lcdfw->db5_i = 5;
-	lcdfw->db4_i = 4;
-	lcdfw->db3_i = 3;
-	lcdfw->db2_i = 2;
-	lcdfw->db1_i = 1;
-	lcdfw->db0_i = 0;
-	lcdfw->rs_port = &PORTD;
-	lcdfw->rw_port = &PORTD;
-	lcdfw->en_port = &PORTD;
-	lcdfw->db7_port = &PORTA;
-	lcdfw->db6_port = &PORTA;
-	lcdfw->db5_port = &PORTA;
-	lcdfw->db4_port = &PORTA;
-	lcdfw->db3_port = &PORTA;
-	lcdfw->db2_port = &PORTA;
-	lcdfw->db1_port = &PORTA;
-	lcdfw->db0_port = &PORTA;
+	const struct hd44780_l_conf wiring = HD44780_L_CONF_INIT;
+
+	*lcdfw = wiring;
+}
+
+void BSP_ConfigureDisplayQueue(struct hd44780fw_conf *fw)
+{
+    queuedDisplay = fw;
+    fw->q_start = StartDisplayQueue;
+
+    /* Timer2 paces the display queue, stopped until there is something */
+    /* to send                                                          */
+    TIMSK2 = 0x00;
+    TCCR2A = 0x00;
+    TCCR2B = 0x00;
+    TIFR2 = 0x07;
+    TCNT2 = 0;
+
+    /* Match every HD44780FW_Q_TICK_US at Clk_io / 64 */
+    OCR2A = DISPLAY_QUEUE_COUNTS - 1;
+
+    /*
+     * TCCR2A Bits 1:0 - Clear Timer on Compare (WGM22 is in TCCR2B)
+     * TCCR2B Bits 2:0 - Select Clk_io / 64 prescaler
+     */
+    TCCR2A = 0x02;
+    TCCR2B = 0x04;
 }
 
 void BSPInterface_SetOutputState(uint8_t id, bool state)
@@ -161,42 +431,77 @@ void BSPInterface_SetOutputState(uint8_t id, bool state)
 
 bool BSPInterface_GetInputState(uint8_t id)
 {
-    bool state = false;
-
-    /* the buzz inputs have interrupt-on-falling-edge set, so for those, the */
-    /* state is true if either the interrupt flag is asserted or the line    */
-    /* itself is low.  When requested, also clear the interrupt flag         */
-    switch((bsp_inputs_t)id)
+    if (BSP_NUMBER_OF_INPUTS <= id)
     {
-    case BSP_INPUT_BUZZ_LEFT_POST:
-        if (!(PINB & _BV(2)) || (EIFR & _BV(2)))
-        {
-            state = true;
-        }
+        return false;
+    }
 
-        EIFR |= _BV(2);
-        break;
-    case BSP_INPUT_BUZZ_RIGHT_POST:
-        if (!(PIND & _BV(3)) || (EIFR & _BV(1)))
-        {
-            state = true;
-        }
+    /* The filtered state, the one the events report */
+    return inputs[id].state;
+}
 
-        EIFR |= _BV(1);
-        break;
-    case BSP_INPUT_BUZZ_WIRE:
-        if (!(PIND & _BV(2)) || (EIFR & _BV(0)))
-        {
-            state = true;
-        }
+bool BSPInterface_GetInputEvent(bsp_input_event_t *event)
+{
+    return Ring_Pop(&inputQueue, event);
+}
 
-        EIFR |= _BV(0);
-        break;
-    default:
-        /* do nothing */
-        break;
+void BSPInterface_SetInputListener(bsp_input_listener_t listener)
+{
+    inputListening = false;
+    inputListener = listener;
+    inputListening = (NULL != listener);
+}
+
+void BSPInterface_ReadStorage(uint16_t address, void *data, uint16_t length)
+{
+    eeprom_read_block(data, (const void *)(uintptr_t)address, length);
+}
+
+bool BSPInterface_WriteStorage(uint16_t address, const void *data, uint16_t length)
+{
+    if (BSPInterface_StorageBusy())
+    {
+        return false;
     }
 
-    return state;
+    /* The interrupt is off, so the block can be set up before it starts */
+    storageData = data;
+    storageAddress = address;
+    storageLength = length;
+
+    /* It fires at once, the EEPROM is ready */
+    EECR |= _BV(EERIE);
+
+    return true;
 }
 
+bool BSPInterface_StorageBusy(void)
+{
+    return 0 != (EECR & _BV(EERIE));
+}
+
+bool BSPInterface_Sleep(bsp_awake_t awake)
+{
+    bool slept = false;
+
+    /* The timers and the external interrupts keep running in idle */
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    cli();
+
+    if (!awake())
+    {
+        /* The instruction after sei always runs before an interrupt is */
+        /* serviced, so one that is pending already wakes the sleep      */
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+
+        slept = true;
+    }
+
+    sei();
+
+    return slept;
+}
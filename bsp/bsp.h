@@ -21,6 +21,33 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "lib44780fw/hd44780fw.h"
 
+/* LCD wiring, D0-D7 on PORTA and the control lines on PORTD */
+#define BSP_LCD_RS_PORT  (&PORTD)
+#define BSP_LCD_RS_I     4
+#define BSP_LCD_RW_PORT  (&PORTD)
+#define BSP_LCD_RW_I     5
+#define BSP_LCD_EN_PORT  (&PORTD)
+#define BSP_LCD_EN_I     6
+#define BSP_LCD_DB_PORT  (&PORTA)
+
+/* The same wiring as a constant initializer.  The LCD low level driver    */
+/* uses it instead of the run-time configuration when it is built with     */
+/* HD44780_L_STATIC_CONF and HD44780_L_CONF_HEADER=bsp/bsp.h defined       */
+#define HD44780_L_CONF_INIT                                                  \
+{                                                                            \
+    .rs_i = BSP_LCD_RS_I, .rw_i = BSP_LCD_RW_I, .en_i = BSP_LCD_EN_I,       \
+    .db7_i = 7, .db6_i = 6, .db5_i = 5, .db4_i = 4,                          \
+    .db3_i = 3, .db2_i = 2, .db1_i = 1, .db0_i = 0,                          \
+    .rs_port = BSP_LCD_RS_PORT, .rw_port = BSP_LCD_RW_PORT,                  \
+    .en_port = BSP_LCD_EN_PORT,                                              \
+    .db7_port = BSP_LCD_DB_PORT, .db6_port = BSP_LCD_DB_PORT,                \
+    .db5_port = BSP_LCD_DB_PORT, .db4_port = BSP_LCD_DB_PORT,                \
+    .db3_port = BSP_LCD_DB_PORT, .db2_port = BSP_LCD_DB_PORT,                \
+    .db1_port = BSP_LCD_DB_PORT, .db0_port = BSP_LCD_DB_PORT,                \
+    .dl = HD44780_L_FS_DL_8BIT,                                              \
+    .bf = HD44780_L_BF_POLL  /* R/W is wired, so BF can be read back */      \
+}
+
 typedef enum
 {
     BSP_OUTPUT_LED_GROUP0 = 0,
@@ -31,9 +58,46 @@ typedef enum
 {
     BSP_INPUT_BUZZ_LEFT_POST = 0,
     BSP_INPUT_BUZZ_RIGHT_POST,
-    BSP_INPUT_BUZZ_WIRE
+    BSP_INPUT_BUZZ_WIRE,
+    BSP_NUMBER_OF_INPUTS
 } bsp_inputs_t;
 
+/*
+ * Input filters, in ms of the tick.  Each input is sampled every tick and
+ * integrated: a contact is reported once it has been sensed for the contact
+ * time more often than not, and its end once it has been gone for the
+ * release time more often than not.  Contacts caught by the external
+ * interrupts count for the tick they occur in, however short.
+ *
+ * Longer times reject more noise and bounce, at the cost of a longer
+ * shortest contact that is reported, and of reporting later.  Reported
+ * changes are timed from their first edge, so the delay does not affect
+ * the game time
+ */
+#ifndef BSP_LEFT_POST_CONTACT_MS
+#define BSP_LEFT_POST_CONTACT_MS  5
+#endif
+
+#ifndef BSP_LEFT_POST_RELEASE_MS
+#define BSP_LEFT_POST_RELEASE_MS  10
+#endif
+
+#ifndef BSP_RIGHT_POST_CONTACT_MS
+#define BSP_RIGHT_POST_CONTACT_MS 1
+#endif
+
+#ifndef BSP_RIGHT_POST_RELEASE_MS
+#define BSP_RIGHT_POST_RELEASE_MS 10
+#endif
+
+#ifndef BSP_WIRE_CONTACT_MS
+#define BSP_WIRE_CONTACT_MS       1
+#endif
+
+#ifndef BSP_WIRE_RELEASE_MS
+#define BSP_WIRE_RELEASE_MS       20
+#endif
+
 /**
  * @brief Configures the LCD driver struct hookups
  *
@@ -41,5 +105,14 @@ typedef enum
  */
 void BSP_ConfigureDisplay(struct hd44780_l_conf *lcdfw);
 
+/**
+ * @brief Drives the LCD framework output queue from a timer interrupt
+ *
+ * Must be called before the framework is initialized
+ *
+ * @param fw Pointer to the display framework struct to service
+ */
+void BSP_ConfigureDisplayQueue(struct hd44780fw_conf *fw);
+
 #endif /* __BUZZWIRE_BSP_H__ */
 
@@ -19,17 +19,59 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <avr/interrupt.h>
 #include <avr/io.h>
 
-static uint16_t ticks;
+#include "common/bsp_interface.h"
+
+#include "timers.h"
+
+/* Build time checks of the tick settings */
+#define BSP_TICK_CHECK(name, condition) typedef char name[(condition) ? 1 : -1]
+
+BSP_TICK_CHECK(bsp_tick_prescaler_valid, 0 != BSP_TICK_CLOCK_SELECT);
+BSP_TICK_CHECK(bsp_tick_fits_timer, (BSP_TICK_COUNTS + (0 < BSP_TICK_REMAINDER)) <= 256);
+BSP_TICK_CHECK(bsp_tick_resolvable, 2 <= BSP_TICK_COUNTS);
+
+static volatile uint32_t ticks;
+
+#if 0 < BSP_TICK_REMAINDER
+/* Fractions of a count accumulated up to the end of the tick under way, */
+/* in 1/BSP_TICK_DIVISOR                                                 */
+static uint32_t tickFraction;
+#endif
 
 ISR(TIMER0_COMPA_vect)
 {
+#if 0 < BSP_TICK_REMAINDER
+    /* Set the length of the next tick, a count longer if the fractions */
+    /* make up a whole one by its end, so the ticks never fall a count   */
+    /* behind the clock.  The count restarted at the match, so it is     */
+    /* still short of either value                                       */
+    tickFraction += BSP_TICK_REMAINDER;
+
+    if (BSP_TICK_DIVISOR <= tickFraction)
+    {
+        tickFraction -= BSP_TICK_DIVISOR;
+        OCR0A = BSP_TICK_COUNTS;
+    }
+    else
+    {
+        OCR0A = BSP_TICK_COUNTS - 1;
+    }
+#endif
+
     ticks++;
+
+    BSP_SampleInputs();
 }
 
 void BSP_InitializeTimers(void)
 {
     ticks = 0;
 
+#if 0 < BSP_TICK_REMAINDER
+    /* The fraction of the first tick, which is a short one */
+    tickFraction = BSP_TICK_REMAINDER;
+#endif
+
     /* Set up for 1ms ticks using Timer0 */
 
     /* First, halt the timers to make sure that we */
@@ -44,10 +86,12 @@ void BSP_InitializeTimers(void)
     /* Clear the timer register */
     TCNT0 = 0;
 
-    /* Set OCR0A to match every 1ms (at 1MHz and Clk_io / 8 )
-     * that is every 125 counts
+    /* Set OCR0A to match every 1ms.  The timer clears on the count after
+     * the match, so a tick is OCR0A + 1 counts: 124 for the 125 counts of
+     * 1MHz and Clk_io / 8.  The first tick is the shorter one if the clock
+     * does not divide into ticks
      */
-    OCR0A = 125;
+    OCR0A = BSP_TICK_COUNTS - 1;
 
     /*
      * Bits 7:6 - Normal port operation, OC0A disconnected
@@ -61,30 +105,59 @@ void BSP_InitializeTimers(void)
      * Bits 7:6 - Do nothing
      * Bits 5:4 - Reserved
      * Bit  3   - Clear Timer on Compare (WGM01:WGM00 is in TCCR0A)
-     * Bits 2:0 - Select Clk_io / 8 prescaler
+     * Bits 2:0 - Select the Clk_io / BSP_TICK_PRESCALER prescaler
      *
      * When this register is set, the counter also starts
      */
-    TCCR0B = 0x02;
+    TCCR0B = BSP_TICK_CLOCK_SELECT;
 
     /* Turn on Output Compare Match A interrupt */
     TIMSK0 = 0x02;
 }
 
-uint16_t BSPInterface_GetTicks(void)
+void BSPInterface_GetTimestamp(bsp_timestamp_t *timestamp)
+{
+    uint32_t ticksNow;
+    uint8_t count;
+    uint32_t us;
+    bool matched;
+
+    do
+    {
+        ticksNow = ticks;
+        count = TCNT0;
+        matched = (0 != (TIFR0 & _BV(OCF0A)));
+    } while (ticksNow != ticks);
+
+    /* A compare match that is not serviced yet (we're in another */
+    /* interrupt, or it is just about to run) already restarted   */
+    /* the count if it reads low                                  */
+    if (matched && (count < (OCR0A / 2)))
+    {
+        ticksNow++;
+    }
+
+    /* A tick that is a count longer can run a count past 1ms */
+    us = ((uint32_t)count * BSP_TICK_COUNT_US_Q8) >> 8;
+
+    timestamp->ticks = ticksNow;
+    timestamp->us = (999 < us) ? 999 : (uint16_t)us;
+}
+
+uint32_t BSPInterface_GetTicks(void)
 {
     /*
-     * This is a 8-bit micro, so need to disable interrupts to prevent
-     * interrupts from causing a rollover in middle of updating the
-     * 16-bit tick value by temporarily disabling timer0 interrupts
+     * This is a 8-bit micro, so an interrupt can increment the 32-bit
+     * tick value in the middle of reading it.  Rather than disabling
+     * the interrupt, read it twice: ticks are 1ms apart, so two equal
+     * readings mean neither was torn
      */
-    uint16_t ticksToReturn;
+    uint32_t ticksToReturn;
 
-    TIMSK0 = 0x00;
-
-    ticksToReturn = ticks;
-
-    TIMSK0 = 0x02;
+    do
+    {
+        ticksToReturn = ticks;
+    } while (ticksToReturn != ticks);
 
     return ticksToReturn;
 }
@@ -19,10 +19,58 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef __BUZZWIRE_BSP_TIMERS_H__
 #define __BUZZWIRE_BSP_TIMERS_H__
 
+#include <stdint.h>
+
+/**
+ * @brief Prescaler of the tick timer, Timer0, from Clk_io
+ *
+ * One of 1, 8, 64, 256 or 1024.  A larger one gives the timestamps a
+ * coarser resolution, of BSP_TICK_PRESCALER / F_CPU, but is needed to
+ * fit a tick in the 8-bit timer at a faster clock
+ */
+#ifndef BSP_TICK_PRESCALER
+#define BSP_TICK_PRESCALER 8
+#endif
+
+/**
+ * @brief Tick rate, the common code counts ticks as milliseconds
+ */
+#define BSP_TICK_HZ 1000UL
+
+/*
+ * Timer0 counts in a tick: a whole number, and a fraction of
+ * BSP_TICK_REMAINDER / BSP_TICK_DIVISOR of a count.  When the clock does
+ * not divide into ticks, the fractions are accumulated and every tick they
+ * make up a whole count is a count longer, so the ticks keep exact time
+ * over any length of time
+ */
+#define BSP_TICK_DIVISOR   (BSP_TICK_PRESCALER * BSP_TICK_HZ)
+#define BSP_TICK_COUNTS    (F_CPU / BSP_TICK_DIVISOR)
+#define BSP_TICK_REMAINDER (F_CPU % BSP_TICK_DIVISOR)
+
+/* Microseconds of a count, in 1/256ths */
+#define BSP_TICK_COUNT_US_Q8 \
+    ((((uint64_t)BSP_TICK_PRESCALER * 256000000UL) + (F_CPU / 2)) / F_CPU)
+
+/* Clock select bits of TCCR0B for the prescaler */
+#define BSP_TICK_CLOCK_SELECT              \
+    ((1    == BSP_TICK_PRESCALER) ? 0x01 : \
+     (8    == BSP_TICK_PRESCALER) ? 0x02 : \
+     (64   == BSP_TICK_PRESCALER) ? 0x03 : \
+     (256  == BSP_TICK_PRESCALER) ? 0x04 : \
+     (1024 == BSP_TICK_PRESCALER) ? 0x05 : 0x00)
+
 /**
  * @brief Initialize the timer subsystem
  */
 void BSP_InitializeTimers(void);
 
+/**
+ * @brief Runs the input filters for one tick
+ *
+ * Called from the tick interrupt
+ */
+void BSP_SampleInputs(void);
+
 #endif /* __BUZZWIRE_BSP_TIMERS_H__ */
 
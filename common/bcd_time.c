@@ -0,0 +1,191 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bcd_time.h"
+
+/**
+ * @brief Converts two packed BCD digits to binary
+ *
+ * @param bcd Packed BCD digits
+ * @return Binary value
+ */
+static uint8_t FromBcd(uint8_t bcd)
+{
+    return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+/**
+ * @brief Converts a binary value below 100 to two packed BCD digits
+ *
+ * @param value Binary value
+ * @return Packed BCD digits
+ */
+static uint8_t ToBcd(uint8_t value)
+{
+    uint8_t tens = 0;
+
+    while (10 <= value)
+    {
+        value -= 10;
+        tens++;
+    }
+
+    return (tens << 4) | value;
+}
+
+/**
+ * @brief Adds a tenth of a second, carrying into the seconds and minutes
+ *
+ * @param time Pointer to the time counter
+ */
+static void AddTenth(bcd_time_t *time)
+{
+    if (0x9 > time->tenths)
+    {
+        time->tenths++;
+        return;
+    }
+
+    /* Saturate rather than roll over to 000:00.0 */
+    if ((0x999 == time->minutes) && (0x59 == time->seconds))
+    {
+        return;
+    }
+
+    time->tenths = 0;
+
+    if (0x9 > (time->seconds & 0x0F))
+    {
+        time->seconds++;
+        return;
+    }
+
+    time->seconds = (time->seconds & 0xF0) + 0x10;
+
+    if (0x60 > time->seconds)
+    {
+        return;
+    }
+
+    time->seconds = 0;
+
+    if (0x9 > (time->minutes & 0x00F))
+    {
+        time->minutes++;
+    }
+    else if (0x90 > (time->minutes & 0x0F0))
+    {
+        time->minutes = (time->minutes & 0xFF0) + 0x010;
+    }
+    else
+    {
+        time->minutes = (time->minutes & 0xF00) + 0x100;
+    }
+}
+
+/**
+ * @brief Adds a time split into minutes, seconds and tenths
+ *
+ * @param time Pointer to the time counter
+ * @param ms Number of milliseconds to add
+ */
+static void AddSplit(bcd_time_t *time, uint32_t ms)
+{
+    /* Split the time added into fields, so the cost does not grow with it */
+    uint32_t minutes = ms / 60000UL;
+    uint16_t rest = (uint16_t)(ms % 60000UL);
+    uint8_t seconds = rest / 1000;
+    uint8_t tenths;
+
+    rest %= 1000;
+    tenths = rest / 100;
+    rest = (rest % 100) + time->ms;
+
+    /* Add each field with a carry into the next */
+    if (100 <= rest)
+    {
+        rest -= 100;
+        tenths++;
+    }
+
+    time->ms = (uint8_t)rest;
+
+    tenths += time->tenths;
+
+    if (10 <= tenths)
+    {
+        tenths -= 10;
+        seconds++;
+    }
+
+    seconds += FromBcd(time->seconds);
+
+    if (60 <= seconds)
+    {
+        seconds -= 60;
+        minutes++;
+    }
+
+    minutes += (time->minutes >> 8) * 100 + FromBcd((uint8_t)time->minutes);
+
+    /* Saturate rather than roll over to 000:00.0 */
+    if (999 < minutes)
+    {
+        time->tenths = 0x9;
+        time->seconds = 0x59;
+        time->minutes = 0x999;
+        return;
+    }
+
+    time->tenths = tenths;
+    time->seconds = ToBcd(seconds);
+    time->minutes = ((uint16_t)(minutes / 100) << 8) | ToBcd(minutes % 100);
+}
+
+void BcdTime_Reset(bcd_time_t *time)
+{
+    time->ms = 0;
+    time->tenths = 0;
+    time->seconds = 0;
+    time->minutes = 0;
+}
+
+void BcdTime_Add(bcd_time_t *time, uint32_t ms)
+{
+    /* Less than a second, as on each refresh: a few carries are cheaper */
+    /* than the divides                                                  */
+    if (1000 <= ms)
+    {
+        AddSplit(time, ms);
+        return;
+    }
+
+    while (100 <= ms)
+    {
+        AddTenth(time);
+        ms -= 100;
+    }
+
+    time->ms += ms;
+
+    if (100 <= time->ms)
+    {
+        time->ms -= 100;
+        AddTenth(time);
+    }
+}
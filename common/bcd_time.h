@@ -0,0 +1,58 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COMMON_BCD_TIME_H__
+#define __COMMON_BCD_TIME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Time counter kept as packed BCD digits
+ *
+ * Each digit can be shown by adding '0' to its nibble, so a display of the
+ * time never has to divide.  The counter saturates at 999:59.9
+ */
+typedef struct
+{
+    uint8_t ms;        //!< Milliseconds into the tenth, binary (0 - 99)
+    uint8_t tenths;    //!< Tenths of a second, BCD (0 - 9)
+    uint8_t seconds;   //!< Seconds, packed BCD (0x00 - 0x59)
+    uint16_t minutes;  //!< Minutes, packed BCD (0x000 - 0x999)
+} bcd_time_t;
+
+/**
+ * @brief Sets a time counter to 0
+ *
+ * @param time Pointer to the time counter
+ */
+void BcdTime_Reset(bcd_time_t *time);
+
+/**
+ * @brief Advances a time counter
+ *
+ * Less than a second is added a tenth at a time.  More is split into
+ * minutes, seconds and tenths, each added with a carry into the next, so
+ * the cost does not grow with how much time is added
+ *
+ * @param time Pointer to the time counter
+ * @param ms Number of milliseconds to add
+ */
+void BcdTime_Add(bcd_time_t *time, uint32_t ms);
+
+#endif /* __COMMON_BCD_TIME_H__ */
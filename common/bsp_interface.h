@@ -22,6 +22,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include <stdbool.h>
 
+/**
+ * @brief Time of an event, finer than a tick
+ */
+typedef struct
+{
+    uint32_t ticks;  //!< Tick the event occurred in
+    uint16_t us;     //!< Microseconds into that tick
+} bsp_timestamp_t;
+
+/**
+ * @brief Change of an input interface
+ */
+typedef struct
+{
+    uint8_t id;                 //!< Identifier of the functionality
+    bool state;                 //!< Logic state it changed to
+    bsp_timestamp_t timestamp;  //!< Time of the change
+} bsp_input_event_t;
+
+/**
+ * @brief Function called from an interrupt when an input event is queued
+ */
+typedef void (*bsp_input_listener_t)(void);
+
+/**
+ * @brief Function that checks if the main loop has work, @see BSPInterface_Sleep
+ */
+typedef bool (*bsp_awake_t)(void);
+
 /**
  * @brief initializes the board layer stuff
  */
@@ -31,13 +60,26 @@ extern void BSPInterface_Initialize(void);
  * @brief Gets the number of ticks
  *
  * This is not intended to act as a RTC, but it will never
- * be intentionally cleared after BSP initialization
+ * be intentionally cleared after BSP initialization.  It is
+ * monotonic until it wraps after about 49.7 days, differences
+ * of two readings are valid across the wrap
+ *
+ * Reading it does not disable interrupts
  *
  * 1 tick == 1ms
  *
  * @return ticks
  */
-extern uint16_t BSPInterface_GetTicks(void);
+extern uint32_t BSPInterface_GetTicks(void);
+
+/**
+ * @brief Gets the current time with sub-tick resolution
+ *
+ * May be called from an interrupt
+ *
+ * @param timestamp Set to the current time
+ */
+extern void BSPInterface_GetTimestamp(bsp_timestamp_t *timestamp);
 
 /**
  * @brief Toggle logic state of an output interface
@@ -58,11 +100,84 @@ extern void BSPInterface_SetOutputState(uint8_t id, bool state);
  * represents a logic state and may not directly correlate
  * to a high or low state of a single input line
  *
+ * The state only changes at the tick, @see Frame_Capture
+ *
  * @param id Identifier of the functionality to change state
  *
  * @return Logic state of the functionality
  */
 extern bool BSPInterface_GetInputState(uint8_t id);
 
+/**
+ * @brief Takes the oldest input event
+ *
+ * Input changes are queued by the hardware as they occur, with the time
+ * they occurred, so none are lost or reordered between polls.  The
+ * board layer filters out contact bounce and noise first
+ *
+ * @param event Set to the event taken
+ *
+ * @return true if there was an event, false if the queue is empty
+ */
+extern bool BSPInterface_GetInputEvent(bsp_input_event_t *event);
+
+/**
+ * @brief Sets the function to call when an input event is queued
+ *
+ * The function is called from an interrupt, after the event is queued
+ *
+ * @param listener Function to call, NULL for none
+ */
+extern void BSPInterface_SetInputListener(bsp_input_listener_t listener);
+
+/**
+ * @brief Sleeps until the next interrupt, unless the main loop has work
+ *
+ * The check is made with interrupts disabled, and they are enabled again
+ * as the processor sleeps.  An interrupt that gives the main loop work
+ * after the check therefore still wakes it, rather than the one after.
+ * The tick interrupt wakes it at least once a tick
+ *
+ * @param awake Function that returns true if the main loop has work, it
+ *              is called with interrupts disabled
+ *
+ * @return true if it slept, false if there was work
+ */
+extern bool BSPInterface_Sleep(bsp_awake_t awake);
+
+/**
+ * @brief Reads a block from the non-volatile storage
+ *
+ * Not to be called while a write is in progress, @see BSPInterface_StorageBusy
+ *
+ * @param address Storage address of the block
+ * @param data Set to the block
+ * @param length Number of bytes to read
+ */
+extern void BSPInterface_ReadStorage(uint16_t address, void *data, uint16_t length);
+
+/**
+ * @brief Starts writing a block to the non-volatile storage
+ *
+ * The block is written in the background, a byte at a time from an
+ * interrupt, so the caller never waits for the storage.  The bytes are
+ * written in order, and the data must be left unchanged until the write
+ * is done
+ *
+ * @param address Storage address of the block
+ * @param data The block to write
+ * @param length Number of bytes to write
+ *
+ * @return true if the write started, false if one is still in progress
+ */
+extern bool BSPInterface_WriteStorage(uint16_t address, const void *data, uint16_t length);
+
+/**
+ * @brief Queries if a write to the non-volatile storage is in progress
+ *
+ * @return true if a write is in progress
+ */
+extern bool BSPInterface_StorageBusy(void);
+
 #endif /* __COMMON_BSP_INTERFACE_H__ */
 
@@ -0,0 +1,73 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "frame.h"
+
+typedef char frame_inputs_fit[(FRAME_INPUTS <= 8) ? 1 : -1];
+
+static frame_t frame;
+
+void Frame_Capture(void)
+{
+    uint8_t inputs;
+    uint8_t id;
+
+    /* The inputs only change in the tick, so if the tick is the same */
+    /* after reading them, they were all read at the time captured    */
+    do
+    {
+        BSPInterface_GetTimestamp(&frame.time);
+
+        inputs = 0;
+
+        for (id = 0; id < FRAME_INPUTS; id++)
+        {
+            if (BSPInterface_GetInputState(id))
+            {
+                inputs |= (uint8_t)(1 << id);
+            }
+        }
+    } while (frame.time.ticks != BSPInterface_GetTicks());
+
+    frame.inputs = inputs;
+}
+
+const frame_t *Frame_Get(void)
+{
+    return &frame;
+}
+
+uint32_t Frame_GetTicks(void)
+{
+    return frame.time.ticks;
+}
+
+void Frame_GetTimestamp(bsp_timestamp_t *timestamp)
+{
+    *timestamp = frame.time;
+}
+
+bool Frame_GetInputState(uint8_t id)
+{
+    if (FRAME_INPUTS <= id)
+    {
+        return false;
+    }
+
+    return 0 != (frame.inputs & (1 << id));
+}
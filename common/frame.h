@@ -0,0 +1,86 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COMMON_FRAME_H__
+#define __COMMON_FRAME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bsp_interface.h"
+
+/**
+ * @brief Number of inputs captured in a frame, from id 0
+ */
+#ifndef FRAME_INPUTS
+#define FRAME_INPUTS 8
+#endif
+
+/**
+ * @brief The time and the inputs, as of one instant
+ */
+typedef struct
+{
+    bsp_timestamp_t time;  //!< When the frame was captured
+    uint8_t inputs;        //!< Logic state of the inputs, bit n for id n
+} frame_t;
+
+/**
+ * @brief Captures the time and the inputs
+ *
+ * To be called once per pass of the main loop, before the modules run.
+ * The modules then all see the same instant, however long the pass
+ * takes, and the hardware is read once instead of by each of them.
+ *
+ * The inputs are read in the same tick as the time, so they are never
+ * from either side of a tick.  Not to be called from interrupts, it
+ * waits for a pending tick to be serviced
+ */
+void Frame_Capture(void);
+
+/**
+ * @brief Gets the captured frame
+ *
+ * @return The frame
+ */
+const frame_t *Frame_Get(void);
+
+/**
+ * @brief Gets the tick of the captured frame
+ *
+ * @return ticks, @see BSPInterface_GetTicks
+ */
+uint32_t Frame_GetTicks(void);
+
+/**
+ * @brief Gets the time of the captured frame
+ *
+ * @param timestamp Set to the time, @see BSPInterface_GetTimestamp
+ */
+void Frame_GetTimestamp(bsp_timestamp_t *timestamp);
+
+/**
+ * @brief Gets the logic state of an input in the captured frame
+ *
+ * @param id Identifier of the functionality, @see BSPInterface_GetInputState
+ *
+ * @return Logic state of the functionality, false if it is not captured
+ */
+bool Frame_GetInputState(uint8_t id);
+
+#endif /* __COMMON_FRAME_H__ */
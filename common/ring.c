@@ -0,0 +1,87 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ring.h"
+
+#include <string.h>
+
+/* Keeps the compiler from moving the copy of an entry across the read */
+/* or the update of the index that hands it over to the other side     */
+#define RING_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+/**
+ * @brief Gets where an entry is stored
+ *
+ * @param ring Pointer to the ring
+ * @param index Free running index of the entry
+ *
+ * @return Pointer to the entry storage
+ */
+static uint8_t *Entry(const ring_t *ring, uint8_t index)
+{
+    return ring->buffer + ((uint16_t)(index & ring->mask) * ring->size);
+}
+
+void Ring_Initialize(ring_t *ring, void *buffer, uint8_t size, uint8_t count)
+{
+    ring->buffer = buffer;
+    ring->size = size;
+    ring->mask = count - 1;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+bool Ring_Push(ring_t *ring, const void *entry)
+{
+    uint8_t head = ring->head;
+
+    if ((uint8_t)(head - ring->tail) > ring->mask)
+    {
+        return false;
+    }
+
+    memcpy(Entry(ring, head), entry, ring->size);
+
+    RING_BARRIER();
+    ring->head = head + 1;
+
+    return true;
+}
+
+bool Ring_Pop(ring_t *ring, void *entry)
+{
+    uint8_t tail = ring->tail;
+
+    if (ring->head == tail)
+    {
+        return false;
+    }
+
+    RING_BARRIER();
+    memcpy(entry, Entry(ring, tail), ring->size);
+
+    RING_BARRIER();
+    ring->tail = tail + 1;
+
+    return true;
+}
+
+bool Ring_IsEmpty(const ring_t *ring)
+{
+    return ring->head == ring->tail;
+}
@@ -0,0 +1,86 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COMMON_RING_H__
+#define __COMMON_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Lock-free queue of fixed size entries between one producer and
+ *        one consumer
+ *
+ * The producer only writes the head and the consumer only writes the tail,
+ * both single bytes, so an interrupt can push while the main loop pops
+ * without either disabling interrupts.  Entries come out in the order they
+ * were pushed
+ */
+typedef struct
+{
+    uint8_t *buffer;        //!< Storage for the entries
+    uint8_t size;           //!< Size of an entry in bytes
+    uint8_t mask;           //!< Number of entries - 1
+    volatile uint8_t head;  //!< Count of entries pushed, wraps
+    volatile uint8_t tail;  //!< Count of entries popped, wraps
+} ring_t;
+
+/**
+ * @brief Initializes a ring
+ *
+ * @param ring Pointer to the ring
+ * @param buffer Storage for count entries of size bytes
+ * @param size Size of an entry in bytes
+ * @param count Number of entries, a power of 2 up to 128
+ */
+void Ring_Initialize(ring_t *ring, void *buffer, uint8_t size, uint8_t count);
+
+/**
+ * @brief Adds an entry to the ring
+ *
+ * To be called only by the producer
+ *
+ * @param ring Pointer to the ring
+ * @param entry Entry to copy in
+ *
+ * @return true if the entry was added, false if the ring is full
+ */
+bool Ring_Push(ring_t *ring, const void *entry);
+
+/**
+ * @brief Takes the oldest entry out of the ring
+ *
+ * To be called only by the consumer
+ *
+ * @param ring Pointer to the ring
+ * @param entry Set to the entry taken out
+ *
+ * @return true if an entry was taken out, false if the ring is empty
+ */
+bool Ring_Pop(ring_t *ring, void *entry);
+
+/**
+ * @brief Queries if the ring is empty
+ *
+ * @param ring Pointer to the ring
+ *
+ * @return true if there is no entry to pop
+ */
+bool Ring_IsEmpty(const ring_t *ring);
+
+#endif /* __COMMON_RING_H__ */
@@ -0,0 +1,306 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scheduler.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "frame.h"
+
+/* Tasks, highest priority first */
+static task_t *tasks;
+
+/* Where the time awake and asleep is added, and when it last woke */
+static scheduler_duty_t *account;
+static bsp_timestamp_t woke;
+
+/**
+ * @brief Checks if a timestamp comes before another
+ *
+ * @return true if a is earlier than b
+ */
+static bool Earlier(const bsp_timestamp_t *a, const bsp_timestamp_t *b)
+{
+    const int32_t ticks = (int32_t)(a->ticks - b->ticks);
+
+    return (ticks < 0) || ((0 == ticks) && (a->us < b->us));
+}
+
+/**
+ * @brief Gets the time between two timestamps
+ *
+ * @param from The earlier timestamp
+ * @param to The later timestamp
+ *
+ * @return Microseconds from one to the other, 0 if to is not later and
+ *         saturated if it is too far
+ */
+static uint32_t Elapsed(const bsp_timestamp_t *from, const bsp_timestamp_t *to)
+{
+    const uint32_t ticks = to->ticks - from->ticks;
+    uint32_t us;
+
+    if (!Earlier(from, to))
+    {
+        return 0;
+    }
+
+    if ((UINT32_MAX / 1000UL) <= ticks)
+    {
+        return UINT32_MAX;
+    }
+
+    us = (ticks * 1000UL) + to->us;
+
+    return us - from->us;
+}
+
+/**
+ * @brief Makes a periodic task ready, from its timer
+ *
+ * @param context The task
+ */
+static void PeriodElapsed(void *context)
+{
+    Scheduler_Signal((task_t *)context);
+}
+
+/**
+ * @brief Takes the ready state of a task
+ *
+ * @param task Pointer to the task object
+ * @param readied Set to when the task was made ready, the earliest if it
+ *                was made ready more than once
+ *
+ * @return true if the task was ready, its ready state is cleared
+ */
+static bool TakeReady(task_t *task, bsp_timestamp_t *readied)
+{
+    bool ready = false;
+
+    if (task->signalled)
+    {
+        /* The interrupt does not touch the time while it is signalled */
+        *readied = task->raised;
+        task->signalled = false;
+        ready = true;
+    }
+
+    if (task->ready)
+    {
+        if (!ready || Earlier(&task->readied, readied))
+        {
+            *readied = task->readied;
+        }
+
+        task->ready = false;
+        ready = true;
+    }
+
+    return ready;
+}
+
+/**
+ * @brief Checks if there is work for the main loop
+ *
+ * Called with interrupts disabled, @see BSPInterface_Sleep
+ *
+ * @return true if a task is ready or a timer is due
+ */
+static bool Awake(void)
+{
+    const task_t *task;
+
+    for (task = tasks; NULL != task; task = task->next)
+    {
+        if (task->ready || task->signalled)
+        {
+            return true;
+        }
+    }
+
+    return Timer_Due(BSPInterface_GetTicks());
+}
+
+/**
+ * @brief Sleeps until there is work, and accounts for the time
+ */
+static void Idle(void)
+{
+    bsp_timestamp_t start;
+    bsp_timestamp_t end;
+    uint32_t wakes = 0;
+
+    BSPInterface_GetTimestamp(&start);
+
+    /* Interrupts that leave no work, like most ticks, sleep again */
+    while (BSPInterface_Sleep(Awake))
+    {
+        wakes++;
+    }
+
+    if ((NULL == account) || (0 == wakes))
+    {
+        return;
+    }
+
+    BSPInterface_GetTimestamp(&end);
+
+    account->awake += Elapsed(&woke, &start);
+    account->asleep += Elapsed(&start, &end);
+    account->wakes += wakes;
+
+    woke = end;
+}
+
+void Scheduler_AddTask(task_t *task, task_fp run, uint8_t priority, uint32_t period)
+{
+    task_t **link = &tasks;
+
+    task->run = run;
+    task->priority = priority;
+    task->ready = false;
+    task->signalled = false;
+
+    Scheduler_ResetStats(task);
+
+    /* Keep the list in priority order, after the tasks of the same priority */
+    while ((NULL != *link) && ((*link)->priority <= priority))
+    {
+        link = &(*link)->next;
+    }
+
+    task->next = *link;
+    *link = task;
+
+    /* A task without a period only runs when it is signalled */
+    Timer_Initialize(&task->timer, TIMER_MODE_RECURRING, period);
+
+    /* Periodic tasks run on the first dispatch, then every period */
+    if (0 < period)
+    {
+        Timer_SetCallback(&task->timer, PeriodElapsed, task);
+        Scheduler_Signal(task);
+    }
+}
+
+void Scheduler_Signal(task_t *task)
+{
+    if (!task->ready)
+    {
+        BSPInterface_GetTimestamp(&task->readied);
+        task->ready = true;
+    }
+}
+
+void Scheduler_SignalFromInterrupt(task_t *task)
+{
+    bsp_timestamp_t now;
+
+    if (!task->signalled)
+    {
+        BSPInterface_GetTimestamp(&now);
+        task->raised = now;
+        task->signalled = true;
+    }
+}
+
+bool Scheduler_Dispatch(void)
+{
+    task_t *task;
+    bsp_timestamp_t readied;
+    bsp_timestamp_t start;
+    bsp_timestamp_t end;
+    uint32_t time;
+
+    Frame_Capture();
+    Timer_Service();
+
+    for (task = tasks; NULL != task; task = task->next)
+    {
+        if (TakeReady(task, &readied))
+        {
+            break;
+        }
+    }
+
+    if (NULL == task)
+    {
+        return false;
+    }
+
+    BSPInterface_GetTimestamp(&start);
+    task->run();
+    BSPInterface_GetTimestamp(&end);
+
+    time = Elapsed(&readied, &start);
+
+    if (task->stats.worstLatency < time)
+    {
+        task->stats.worstLatency = time;
+    }
+
+    time = Elapsed(&start, &end);
+    task->stats.runTime = time;
+
+    if (task->stats.worstRunTime < time)
+    {
+        task->stats.worstRunTime = time;
+    }
+
+    task->stats.runs++;
+
+    return true;
+}
+
+void Scheduler_Run(void)
+{
+    for (;;)
+    {
+        if (!Scheduler_Dispatch())
+        {
+            Idle();
+        }
+    }
+}
+
+void Scheduler_GetStats(const task_t *task, task_stats_t *stats)
+{
+    *stats = task->stats;
+}
+
+void Scheduler_ResetStats(task_t *task)
+{
+    memset(&task->stats, 0, sizeof(task_stats_t));
+}
+
+void Scheduler_AccountDuty(scheduler_duty_t *duty)
+{
+    bsp_timestamp_t now;
+
+    BSPInterface_GetTimestamp(&now);
+
+    if (NULL != account)
+    {
+        account->awake += Elapsed(&woke, &now);
+    }
+
+    woke = now;
+    account = duty;
+}
@@ -0,0 +1,146 @@
+/*
+Microcontroller Common Code
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COMMON_SCHEDULER_H__
+#define __COMMON_SCHEDULER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bsp_interface.h"
+#include "timers.h"
+
+/**
+ * @brief Function run by a task, it must return when it has done its work
+ */
+typedef void (*task_fp)(void);
+
+/**
+ * @brief Run statistics of a task, times in microseconds
+ */
+typedef struct
+{
+    uint32_t runs;          //!< Number of times the task ran
+    uint32_t runTime;       //!< Time the last run took
+    uint32_t worstRunTime;  //!< Longest time a run took
+    uint32_t worstLatency;  //!< Longest time from being made ready to
+                            //!< starting to run
+} task_stats_t;
+
+/**
+ * @brief Time the processor spent awake and asleep, in microseconds
+ *
+ * The duty cycle is the time awake over the total.  Interrupts serviced
+ * while asleep count as asleep
+ */
+typedef struct
+{
+    uint32_t wakes;   //!< Number of times the processor woke from sleep
+    uint64_t awake;   //!< Time spent dispatching tasks
+    uint64_t asleep;  //!< Time spent sleeping
+} scheduler_duty_t;
+
+typedef struct task
+{
+    task_fp run;
+    uint8_t priority;                  //!< 0 is the highest
+    timer_t timer;                     //!< Makes periodic tasks ready
+    bool ready;                        //!< Made ready by the main loop
+    bsp_timestamp_t readied;           //!< When, if ready
+    volatile bool signalled;           //!< Made ready by an interrupt
+    volatile bsp_timestamp_t raised;   //!< When, if signalled
+    task_stats_t stats;
+    struct task *next;                 //!< Next task in priority order
+} task_t;
+
+/**
+ * @brief Adds a task to the scheduler
+ *
+ * The task object is held by the scheduler, so it must not go out of scope
+ *
+ * @param task Pointer to the task object
+ * @param run Function the task runs
+ * @param priority Priority, 0 is the highest.  Tasks of equal priority
+ *                 run in the order they were added
+ * @param period Milliseconds between runs, starting with the first
+ *               dispatch, up to TIMER_SHORT_MAX_PERIOD.  0 for a task that
+ *               only runs when signalled
+ */
+void Scheduler_AddTask(task_t *task, task_fp run, uint8_t priority, uint32_t period);
+
+/**
+ * @brief Makes a task ready to run
+ *
+ * A task signalled several times before it runs, runs once
+ *
+ * @param task Pointer to the task object
+ */
+void Scheduler_Signal(task_t *task);
+
+/**
+ * @brief Makes a task ready to run, from an interrupt
+ *
+ * Only to be called from interrupts, @see Scheduler_Signal otherwise
+ *
+ * @param task Pointer to the task object
+ */
+void Scheduler_SignalFromInterrupt(task_t *task);
+
+/**
+ * @brief Captures the frame and runs the timer service, then the ready
+ *        task of highest priority
+ *
+ * @return true if a task ran, false if none was ready
+ */
+bool Scheduler_Dispatch(void);
+
+/**
+ * @brief Dispatches tasks forever
+ *
+ * When no task is ready and no timer is due, the processor sleeps until
+ * an interrupt makes a task ready or the tick reaches the next deadline
+ */
+void Scheduler_Run(void);
+
+/**
+ * @brief Gets the run statistics of a task
+ *
+ * @param task Pointer to the task object
+ * @param stats Set to the statistics
+ */
+void Scheduler_GetStats(const task_t *task, task_stats_t *stats);
+
+/**
+ * @brief Clears the run statistics of a task
+ *
+ * @param task Pointer to the task object
+ */
+void Scheduler_ResetStats(task_t *task);
+
+/**
+ * @brief Sets where the time awake and asleep is added from now on
+ *
+ * The time up to now is added to the previous account, so the time in
+ * each phase of the application can be kept apart
+ *
+ * @param duty Pointer to the account, it must not go out of scope.  NULL
+ *             to stop accounting
+ */
+void Scheduler_AccountDuty(scheduler_duty_t *duty);
+
+#endif /* __COMMON_SCHEDULER_H__ */
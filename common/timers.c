@@ -18,97 +18,403 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "timers.h"
 
+#include <stddef.h>
+
 #include "bsp_interface.h"
+#include "frame.h"
+
+/* Longest wait that deadline comparisons on the 16-bit tick can span */
+#define TIMER_MAX_WAIT TIMER_SHORT_MAX_PERIOD
+
+/* Set in the mode of a long timer */
+#define TIMER_LONG 0x80
 
-void Timer_Initialize(timer_t *timer, timer_modes_t mode, uint32_t period)
+/* Active timers, as a binary heap ordered by deadline */
+static timer_t *heap[TIMER_SERVICE_SIZE];
+static uint8_t heapSize;
+
+/**
+ * @brief Checks if a deadline comes before another
+ *
+ * @return true if a is earlier than b
+ */
+static bool Before(uint16_t a, uint16_t b)
 {
-    if (TIMER_NUMBER_OF_MODES > mode)
+    return (int16_t)(a - b) < 0;
+}
+
+/**
+ * @brief Gets the long timer a timer is the member of
+ */
+static timer_long_t *Long(timer_t *timer)
+{
+    return (timer_long_t *)timer;
+}
+
+/**
+ * @brief Gets the timeout period of a timer
+ */
+static uint32_t Period(timer_t *timer)
+{
+    return (TIMER_LONG & timer->mode) ? Long(timer)->period : timer->period;
+}
+
+/**
+ * @brief Gets the mode of a timer, without the flags
+ */
+static timer_modes_t Mode(const timer_t *timer)
+{
+    return (timer_modes_t)(timer->mode & ~TIMER_LONG);
+}
+
+/**
+ * @brief Puts a timer at a position of the heap
+ */
+static void Place(timer_t *timer, uint8_t i)
+{
+    heap[i] = timer;
+    timer->slot = i + 1;
+}
+
+/**
+ * @brief Moves a timer towards the top of the heap while it is due earlier
+ *        than its parent
+ */
+static void SiftUp(uint8_t i)
+{
+    timer_t *timer = heap[i];
+
+    while (0 < i)
     {
-        timer->mode = mode;
-        timer->period = period;
+        uint8_t parent = (i - 1) / 2;
+
+        if (!Before(timer->deadline, heap[parent]->deadline))
+        {
+            break;
+        }
+
+        Place(heap[parent], i);
+        i = parent;
     }
-    else
+
+    Place(timer, i);
+}
+
+/**
+ * @brief Moves a timer towards the bottom of the heap while one of its
+ *        children is due earlier
+ */
+static void SiftDown(uint8_t i)
+{
+    timer_t *timer = heap[i];
+
+    for (;;)
     {
-        /* Just set up something rational, have the timer always expire */
-        timer->mode = TIMER_MODE_SINGLE;
-        timer->period = 0;
+        uint16_t child = 2 * (uint16_t)i + 1;
+
+        if (child >= heapSize)
+        {
+            break;
+        }
+
+        if ((child + 1 < heapSize) &&
+            Before(heap[child + 1]->deadline, heap[child]->deadline))
+        {
+            child++;
+        }
+
+        if (!Before(heap[child]->deadline, timer->deadline))
+        {
+            break;
+        }
+
+        Place(heap[child], i);
+        i = child;
     }
 
-    Timer_Reset(timer);
+    Place(timer, i);
 }
 
-void Timer_SetTimeoutPeriod(timer_t *timer, uint32_t period)
+/**
+ * @brief Checks if a timer is held by the service
+ */
+static bool Queued(const timer_t *timer)
 {
-    if (TIMER_NUMBER_OF_MODES > timer->mode)
+    return (0 < timer->slot) && (timer->slot <= heapSize) &&
+           (heap[timer->slot - 1] == timer);
+}
+
+/**
+ * @brief Takes a timer out of the service
+ */
+static void Dequeue(timer_t *timer)
+{
+    uint8_t i = timer->slot - 1;
+
+    timer->slot = 0;
+    heapSize--;
+
+    if (i < heapSize)
     {
-        timer->period = period;
-        Timer_Reset(timer);
+        Place(heap[heapSize], i);
+        SiftUp(i);
+        SiftDown(i);
     }
 }
 
-void Timer_Reset(timer_t *timer)
+/**
+ * @brief Sets the deadline of a timer one period after a tick, and puts it
+ *        in its place in the service
+ *
+ * @param timer Pointer to the timer object
+ * @param tick The tick the period starts at
+ */
+static void Arm(timer_t *timer, uint16_t tick)
 {
-    timer->remaining = timer->period;
-    timer->extra = 0;
-    timer->tick = BSPInterface_GetTicks();
+    /* Long periods are waited for in steps the tick can span */
+    if (TIMER_LONG & timer->mode)
+    {
+        timer_long_t *longTimer = Long(timer);
+        uint32_t wait = longTimer->period;
+
+        if (TIMER_MAX_WAIT < wait)
+        {
+            wait = TIMER_MAX_WAIT;
+        }
+
+        timer->period = (uint16_t)wait;
+        longTimer->remaining = longTimer->period - wait;
+    }
+
+    timer->deadline = tick + timer->period;
+
+    if (Queued(timer))
+    {
+        SiftUp(timer->slot - 1);
+        SiftDown(timer->slot - 1);
+    }
+    else if (TIMER_SERVICE_SIZE > heapSize)
+    {
+        heap[heapSize] = timer;
+        SiftUp(heapSize++);
+    }
 }
 
-bool Timer_Timeout(timer_t *timer)
+void Timer_Service(void)
 {
-    uint16_t currTick = BSPInterface_GetTicks();
-    uint16_t delta = currTick - timer->tick;
-    bool timeoutOccurred = false;
+    const uint16_t currTick = (uint16_t)Frame_GetTicks();
 
-    /* Determination of whether if a timeout event occurred is the same for */
-    /* all modes; is the time elapsed since the last check greater than the */
-    /* time remaining on the timer                                          */
-    if ((0 == timer->remaining) || (delta >= timer->remaining))
+    while ((0 < heapSize) && !Before(currTick, heap[0]->deadline))
     {
-        /* if we overran the timer, calculate the extra time that has */
-        /* elapsed                                                    */
-        if (delta > timer->remaining)
+        timer_t *timer = heap[0];
+        timer_modes_t mode = Mode(timer);
+
+        /* Long periods are waited for in several steps */
+        if ((TIMER_LONG & timer->mode) && (0 < Long(timer)->remaining))
         {
-            timer->extra += delta - timer->remaining;
+            timer_long_t *longTimer = Long(timer);
+            uint32_t wait = longTimer->remaining;
+
+            if (TIMER_MAX_WAIT < wait)
+            {
+                wait = TIMER_MAX_WAIT;
+            }
+
+            timer->deadline += (uint16_t)wait;
+            longTimer->remaining -= wait;
+            SiftDown(0);
+            continue;
         }
 
-        timer->remaining = 0;
-        timeoutOccurred = true;
-
-        /* the action on a timeout event depends on the timer mode.  For a */
-        /* single shot timer, we do nothing, it will always evaluate to an */
-        /* timeout event until we explicitly reset the timer.  For a       */
-        /* recurring timer, we reset it now so that the next timeout event */
-        /* will occur a period from now.  For interval timers, we use the  */
-        /* extra parameter to make the timeout events occur in integer     */
-        /* number of periods since the timer was started                   */
-        if (TIMER_MODE_RECURRING == timer->mode)
+        /* the action on a timeout event depends on the timer mode.  A     */
+        /* single shot timer leaves the service, it will always evaluate   */
+        /* to a timeout event until we explicitly reset the timer.  A      */
+        /* recurring timer is re-armed a period from now, and holds one    */
+        /* event at most.  An interval timer is re-armed a period from its */
+        /* deadline, so that its events occur in integer number of periods */
+        /* since it was started, and it counts the events not consumed     */
+        if (TIMER_MODE_INTERVAL == mode)
         {
-            Timer_Reset(timer);
+            if (UINT8_MAX > timer->pending)
+            {
+                timer->pending++;
+            }
+
+            Arm(timer, timer->deadline);
         }
-        else if (TIMER_MODE_INTERVAL == timer->mode)
+        else
         {
-            /* If the extra time is more than the period, leave the        */
-            /* remaining time as 0 to ensure that the next call will raise */
-            /* the timeout event again, and reduce the extra time by the   */
-            /* period.  If the period is greater than the extra time,      */
-            /* compensate the remaining time to account for the extra time */
-            if (timer->extra >= timer->period)
+            timer->pending = 1;
+
+            if (TIMER_MODE_RECURRING == mode)
             {
-                timer->extra -= timer->period;
+                Arm(timer, currTick);
             }
             else
             {
-                timer->remaining = timer->period - timer->extra;
-                timer->extra = 0;
+                Dequeue(timer);
             }
         }
+
+        if (NULL != timer->callback)
+        {
+            timer->callback(timer->context);
+        }
+    }
+}
+
+bool Timer_Due(uint32_t tick)
+{
+    return (0 < heapSize) && !Before((uint16_t)tick, heap[0]->deadline);
+}
+
+/**
+ * @brief Sets the period of a timer, if it can hold it
+ *
+ * @return false if the period is too long for a short timer
+ */
+static bool SetPeriod(timer_t *timer, uint32_t period)
+{
+    if (TIMER_LONG & timer->mode)
+    {
+        Long(timer)->period = period;
+    }
+    else if (TIMER_SHORT_MAX_PERIOD < period)
+    {
+        return false;
+    }
+    else
+    {
+        timer->period = (uint16_t)period;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Stops a timer given a period it cannot hold, it does not expire
+ *        until it is reset or given a period it can hold
+ */
+static void Reject(timer_t *timer)
+{
+    /* Any period but 0, that one always expires */
+    timer->period = TIMER_SHORT_MAX_PERIOD;
+    timer->pending = 0;
+
+    if (Queued(timer))
+    {
+        Dequeue(timer);
+    }
+}
+
+/**
+ * @brief Sets up a timer of either width
+ *
+ * @param timer Pointer to the timer object
+ * @param mode Operating mode of the timer
+ * @param period The timeout period in milliseconds
+ * @param flags TIMER_LONG for a long timer
+ *
+ * @return false if the period is too long, the timer is then stopped
+ */
+static bool Setup(timer_t *timer, timer_modes_t mode, uint32_t period, uint8_t flags)
+{
+    timer->callback = NULL;
+    timer->context = NULL;
+
+    if (TIMER_NUMBER_OF_MODES > mode)
+    {
+        timer->mode = mode | flags;
+
+        if (!SetPeriod(timer, period))
+        {
+            Reject(timer);
+            return false;
+        }
     }
     else
     {
-        timer->remaining -= delta;
+        /* Just set up something rational, have the timer always expire */
+        timer->mode = TIMER_MODE_SINGLE | flags;
+        SetPeriod(timer, 0);
     }
 
-    timer->tick = currTick;
+    Timer_Reset(timer);
+
+    return true;
+}
+
+/* Named in parentheses, so the checks of the constant periods in */
+/* timers.h are not expanded                                      */
+bool (Timer_Initialize)(timer_t *timer, timer_modes_t mode, uint32_t period)
+{
+    return Setup(timer, mode, period, 0);
+}
+
+void Timer_InitializeLong(timer_long_t *timer, timer_modes_t mode, uint32_t period)
+{
+    Setup(&timer->timer, mode, period, TIMER_LONG);
+}
+
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context)
+{
+    timer->callback = callback;
+    timer->context = context;
+}
+
+bool (Timer_SetTimeoutPeriod)(timer_t *timer, uint32_t period)
+{
+    if (TIMER_NUMBER_OF_MODES > Mode(timer))
+    {
+        if (!SetPeriod(timer, period))
+        {
+            Reject(timer);
+            return false;
+        }
+
+        Timer_Reset(timer);
+    }
+
+    return true;
+}
+
+void Timer_SetTimeoutPeriodLong(timer_long_t *timer, uint32_t period)
+{
+    (Timer_SetTimeoutPeriod)(&timer->timer, period);
+}
+
+void Timer_Reset(timer_t *timer)
+{
+    timer->pending = 0;
+
+    /* A timer without a period is always expired, it needs no service */
+    if (0 == Period(timer))
+    {
+        if (Queued(timer))
+        {
+            Dequeue(timer);
+        }
+    }
+    else
+    {
+        Arm(timer, (uint16_t)Frame_GetTicks());
+    }
+}
+
+bool Timer_Timeout(timer_t *timer)
+{
+    bool timeoutOccurred = true;
+
+    if (0 == timer->pending)
+    {
+        /* A timer without a period is always expired */
+        timeoutOccurred = (0 == Period(timer));
+    }
+    else if (TIMER_MODE_SINGLE != Mode(timer))
+    {
+        /* Consume the event, single shot timers keep it until reset */
+        timer->pending--;
+    }
 
     return timeoutOccurred;
 }
@@ -132,7 +438,7 @@ void Stopwatch_Stop(stopwatch_t *stopwatch)
 void Stopwatch_Start(stopwatch_t *stopwatch)
 {
     stopwatch->running = true;
-    stopwatch->tick = BSPInterface_GetTicks();
+    stopwatch->tick = Frame_GetTicks();
 }
 
 uint32_t Stopwatch_Lap(stopwatch_t *stopwatch)
@@ -147,8 +453,8 @@ void Stopwatch_Update(stopwatch_t *stopwatch)
 {
     if (stopwatch->running)
     {
-        uint16_t currTick = BSPInterface_GetTicks();
-        uint16_t delta = currTick - stopwatch->tick;
+        uint32_t currTick = Frame_GetTicks();
+        uint32_t delta = currTick - stopwatch->tick;
 
         stopwatch->counter += delta;
         stopwatch->tick = currTick;
@@ -22,6 +22,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include <stdbool.h>
 
+/**
+ * @brief Maximum number of timers the timer service can hold
+ *
+ * Timers initialized past this number never expire
+ */
+#ifndef TIMER_SERVICE_SIZE
+#define TIMER_SERVICE_SIZE 16
+#endif
+
 /**
  * @brief enumeration to set the behavior of the timer
  */
@@ -43,30 +52,143 @@ typedef enum
     TIMER_NUMBER_OF_MODES
 } timer_modes_t;
 
+/**
+ * @brief Function called by the timer service when a timer expires
+ *
+ * @param context The context given with the callback
+ */
+typedef void (*timer_callback_t)(void *context);
+
+/**
+ * @brief Longest period of a @see timer_t, in milliseconds
+ *
+ * A longer constant period fails the build.  A longer period only known at
+ * run time is rejected, the timer is then stopped with this period.  Use a
+ * @see timer_long_t to wait longer
+ */
+#define TIMER_SHORT_MAX_PERIOD 0x7FFFUL
+
+/**
+ * @brief A timer of up to TIMER_SHORT_MAX_PERIOD
+ *
+ * The deadline is held in the low 16 bits of the tick, so it is compared
+ * with the tick in a single 16-bit comparison
+ */
 typedef struct
 {
-    timer_modes_t mode;
-    uint32_t period;
-    uint32_t remaining;
-    uint32_t extra;
-    uint16_t tick;
+    uint8_t mode;               //!< timer_modes_t, with a flag for the long
+                                //!< timers
+    uint8_t pending;            //!< Timeout events not yet consumed
+    uint8_t slot;               //!< Position in the service + 1, 0 if idle
+    uint16_t period;            //!< Period, or for a long timer the step it
+                                //!< is waiting
+    uint16_t deadline;          //!< Tick at which the timer expires
+    timer_callback_t callback;
+    void *context;
 } timer_t;
 
+/**
+ * @brief A timer of any period
+ *
+ * Periods longer than TIMER_SHORT_MAX_PERIOD are waited for in steps.  The
+ * timer functions take a pointer to its timer member
+ */
+typedef struct
+{
+    timer_t timer;
+    uint32_t period;
+    uint32_t remaining;         //!< Time left to wait past the current step
+} timer_long_t;
+
 typedef struct
 {
     uint32_t counter;
-    uint16_t tick;
+    uint32_t tick;
     bool running;
 } stopwatch_t;
 
+/**
+ * @brief Expires the timers that are due
+ *
+ * Active timers are kept ordered by deadline, so when nothing is due this
+ * only compares the tick with the earliest deadline.  Expired timers are
+ * re-armed according to their mode and their callbacks called.
+ *
+ * Timers and stopwatches go by the tick of the frame, so they all see the
+ * same instant in a pass, @see Frame_Capture
+ *
+ * To be called once per pass of the main loop, after the frame is captured.
+ * A timer is only seen as expired if it is serviced within
+ * TIMER_SHORT_MAX_PERIOD of its deadline
+ */
+void Timer_Service(void);
+
+/**
+ * @brief Queries if a timer is due at a tick
+ *
+ * Until it is, @see Timer_Service has nothing to do
+ *
+ * @param tick The tick
+ *
+ * @return true if the earliest deadline is at or before the tick
+ */
+bool Timer_Due(uint32_t tick);
+
 /**
  * @brief Initializes a timer object
  *
+ * The timer object is handed to the timer service, so it must not go out
+ * of scope while it is running
+ *
  * @param timer Pointer to the timer object
  * @param mode Operating mode of the timer
+ * @param period The timeout period in milliseconds, up to
+ *               TIMER_SHORT_MAX_PERIOD
+ *
+ * @return false if the period is longer, the timer is then stopped.  A
+ *         longer constant period fails the build, @see TIMER_CHECK_PERIOD
+ */
+bool Timer_Initialize(timer_t *timer, timer_modes_t mode, uint32_t period);
+
+/**
+ * @brief Fails the build where a constant period is longer than a timer_t
+ *        can hold
+ *
+ * The call is only left in when the period is a constant that is too long,
+ * any other call is dropped by the compiler
+ */
+extern void Timer_PeriodTooLong(void)
+    __attribute__((error("period longer than TIMER_SHORT_MAX_PERIOD, use a timer_long_t")));
+
+#define TIMER_CHECK_PERIOD(period)                                           \
+    ((__builtin_constant_p(period) && (TIMER_SHORT_MAX_PERIOD < (period)))   \
+        ? Timer_PeriodTooLong() : (void)0)
+
+#define Timer_Initialize(timer, mode, period)                                \
+    (TIMER_CHECK_PERIOD(period), Timer_Initialize((timer), (mode), (period)))
+
+/**
+ * @brief Initializes a long timer object
+ *
+ * @see Timer_Initialize, the other timer functions are given &timer->timer
+ *
+ * @param timer Pointer to the long timer object
+ * @param mode Operating mode of the timer
  * @param period The timeout period in milliseconds
  */
-void Timer_Initialize(timer_t *timer, timer_modes_t mode, uint32_t period);
+void Timer_InitializeLong(timer_long_t *timer, timer_modes_t mode, uint32_t period);
+
+/**
+ * @brief Sets the function to call when the timer expires
+ *
+ * The callback is called from @see Timer_Service, in addition to the
+ * timeout event that @see Timer_Timeout reports
+ *
+ * @param timer Pointer to the timer object
+ * @param callback Function to call, NULL for none
+ * @param context Passed to the callback
+ */
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context);
 
 /**
  * @brief Set timeout period
@@ -74,9 +196,27 @@ void Timer_Initialize(timer_t *timer, timer_modes_t mode, uint32_t period);
  * Changes the timeout period and resets the timer object
  *
  * @param timer Pointer to the timer object
+ * @param period The new timeout period in milliseconds, up to
+ *               TIMER_SHORT_MAX_PERIOD unless it is a long timer
+ *
+ * @return false if the period is longer and it is not a long timer, the
+ *         timer is then stopped.  A longer constant period fails the build,
+ *         @see Timer_SetTimeoutPeriodLong for a long timer
+ */
+bool Timer_SetTimeoutPeriod(timer_t *timer, uint32_t period);
+
+#define Timer_SetTimeoutPeriod(timer, period)                                \
+    (TIMER_CHECK_PERIOD(period), Timer_SetTimeoutPeriod((timer), (period)))
+
+/**
+ * @brief Set timeout period of a long timer
+ *
+ * @see Timer_SetTimeoutPeriod
+ *
+ * @param timer Pointer to the long timer object
  * @param period The new timeout period in milliseconds
  */
-void Timer_SetTimeoutPeriod(timer_t *timer, uint32_t period);
+void Timer_SetTimeoutPeriodLong(timer_long_t *timer, uint32_t period);
 
 /**
  * @brief Resets the timer
@@ -94,6 +234,9 @@ void Timer_Reset(timer_t *timer);
  * Depending on the mode, consecutive calls may return
  * timeout events @see timer_modes_t
  *
+ * This does not read the tick, timeout events are raised by
+ * @see Timer_Service
+ *
  * @param timer Pointer to the timer object
  *
  * @return true if a timeout event has occurred or if it is an single shot timer
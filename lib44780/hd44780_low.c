@@ -21,6 +21,41 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "hd44780_low.h"
 
+/*
+With HD44780_L_STATIC_CONF defined, the wiring comes from the header named by
+HD44780_L_CONF_HEADER (for instance -DHD44780_L_CONF_HEADER=board/lcd.h) as
+HD44780_L_CONF_INIT, instead of the configuration given at run time. Every
+pin access is then made on a constant address, which lets the compiler use
+single bit instructions.
+*/
+#ifdef HD44780_L_STATIC_CONF
+	#ifndef HD44780_L_CONF_HEADER
+		#error HD44780 low-level driver: HD44780_L_CONF_HEADER must name the wiring header
+	#endif
+
+	#define _HD44780_L_STR(x)	#x
+	#define _HD44780_L_XSTR(x)	_HD44780_L_STR(x)
+	#include _HD44780_L_XSTR(HD44780_L_CONF_HEADER)
+
+	#ifndef HD44780_L_CONF_INIT
+		#error HD44780 low-level driver: HD44780_L_CONF_INIT must be defined by HD44780_L_CONF_HEADER
+	#endif
+
+	static const struct hd44780_l_conf _hd44780_l_sconf = HD44780_L_CONF_INIT;
+
+	#define _HD44780_L_CONF(conf)		(&_hd44780_l_sconf)
+	#define _HD44780_L_INLINE		static inline __attribute__((always_inline))
+#else
+	#define _HD44780_L_CONF(conf)		(conf)
+	#define _HD44780_L_INLINE		static inline
+#endif
+
+/*
+Whether a byte is written with a single store. With a static configuration
+the check is folded at build time, otherwise it is made on each access.
+*/
+#define _HD44780_L_ORDERED(conf)	_hd44780_l_is_ordered(conf)
+
 /**
  * Fix a single bit.
  *
@@ -28,7 +63,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  * @param index		Pin index on AVR port
  * @param value		Value (0 is false; anything else is true)
  */
-static inline void _hd44780_l_fb(volatile uint8_t* port, uint8_t index,
+_HD44780_L_INLINE void _hd44780_l_fb(volatile uint8_t* port, uint8_t index,
 uint8_t value) {
 	if (value == 0) {
 		*port &= ~_BV(index);
@@ -37,15 +72,41 @@ uint8_t value) {
 	}
 }
 
+/**
+ * Checks if DB7 downto DB0 are pins 7 downto 0 of a single AVR port.
+ *
+ * @param conf	HD44780 configuration
+ * @return	1 if a whole byte can be written with a single store
+ */
+_HD44780_L_INLINE uint8_t _hd44780_l_is_ordered(const struct hd44780_l_conf* conf) {
+	volatile uint8_t* port = conf->db0_port;
+	
+	return (conf->dl == HD44780_L_FS_DL_8BIT) &&
+		(conf->db7_port == port) && (conf->db7_i == 7) &&
+		(conf->db6_port == port) && (conf->db6_i == 6) &&
+		(conf->db5_port == port) && (conf->db5_i == 5) &&
+		(conf->db4_port == port) && (conf->db4_i == 4) &&
+		(conf->db3_port == port) && (conf->db3_i == 3) &&
+		(conf->db2_port == port) && (conf->db2_i == 2) &&
+		(conf->db1_port == port) && (conf->db1_i == 1) &&
+		(conf->db0_i == 0);
+}
+
 /**
  * Clears all pins.
  *
  * @param conf	HD44780 configuration
  */
-static inline void _hd44780_l_ca(const struct hd44780_l_conf* conf) {
+_HD44780_L_INLINE void _hd44780_l_ca(const struct hd44780_l_conf* conf) {
 	*(conf->rs_port) &= ~_BV(conf->rs_i);
 	*(conf->rw_port) &= ~_BV(conf->rw_i);
 	*(conf->en_port) &= ~_BV(conf->en_i);
+	
+	if (_HD44780_L_ORDERED(conf)) {
+		*(conf->db0_port) = 0x00;
+		return;
+	}
+	
 	*(conf->db7_port) &= ~_BV(conf->db7_i);
 	*(conf->db6_port) &= ~_BV(conf->db6_i);
 	*(conf->db5_port) &= ~_BV(conf->db5_i);
@@ -64,7 +125,7 @@ static inline void _hd44780_l_ca(const struct hd44780_l_conf* conf) {
  *
  * @param conf	HD44780 configuration
  */
-static inline void _hd44780_l_ec(const struct hd44780_l_conf* conf) {
+_HD44780_L_INLINE void _hd44780_l_ec(const struct hd44780_l_conf* conf) {
 	/* Max write setup time (data) is 80 ns: */
 	_delay_us(0.08); /* _delay_us overhead is probably > 80 ns here... */
 	
@@ -81,6 +142,79 @@ static inline void _hd44780_l_ec(const struct hd44780_l_conf* conf) {
 	_delay_us(0.270);
 }
 
+/**
+ * Sets the direction of all data pins.
+ *
+ * The DDR register of an AVR port is located right before its PORT
+ * register, so it is derived from the configured port pointers.
+ *
+ * @param conf	HD44780 configuration
+ * @param out	Output if true, input otherwise
+ */
+_HD44780_L_INLINE void _hd44780_l_dd(const struct hd44780_l_conf* conf,
+uint8_t out) {
+	if (_HD44780_L_ORDERED(conf)) {
+		*(conf->db0_port - 1) = (out ? 0xff : 0x00);
+		return;
+	}
+	
+	_hd44780_l_fb(conf->db7_port - 1, conf->db7_i, out);
+	_hd44780_l_fb(conf->db6_port - 1, conf->db6_i, out);
+	_hd44780_l_fb(conf->db5_port - 1, conf->db5_i, out);
+	_hd44780_l_fb(conf->db4_port - 1, conf->db4_i, out);
+	
+	if (conf->dl == HD44780_L_FS_DL_8BIT) {
+		_hd44780_l_fb(conf->db3_port - 1, conf->db3_i, out);
+		_hd44780_l_fb(conf->db2_port - 1, conf->db2_i, out);
+		_hd44780_l_fb(conf->db1_port - 1, conf->db1_i, out);
+		_hd44780_l_fb(conf->db0_port - 1, conf->db0_i, out);
+	}
+}
+
+/**
+ * Polls the busy flag until the device is ready.
+ *
+ * BF is read on DB7 (through the PIN register, located two bytes before
+ * the PORT register) while RS is low and R/W is high. Polling gives up
+ * after max_polls reads (at least one) so that a missing device does not
+ * hang the MCU; each read takes more than 1 us, so this is never shorter
+ * than the fixed wait it replaces.
+ *
+ * @param conf		HD44780 configuration
+ * @param max_polls	Maximum number of BF reads
+ */
+static void _hd44780_l_wait_bf(const struct hd44780_l_conf* conf,
+uint16_t max_polls) {
+	uint8_t busy;
+	
+	conf = _HD44780_L_CONF(conf);
+	
+	/* Release the data bus before the device drives it: */
+	_hd44780_l_dd(conf, 0);
+	_hd44780_l_fb(conf->rs_port, conf->rs_i, 0);
+	_hd44780_l_fb(conf->rw_port, conf->rw_i, 1);
+	
+	do {
+		/* Set EN and wait for data delay time (160 ns): */
+		*(conf->en_port) |= _BV(conf->en_i);
+		_delay_us(0.160);
+		busy = *(conf->db7_port - 2) & _BV(conf->db7_i);
+		
+		/* Clear EN and wait for rest of EN cycle time: */
+		*(conf->en_port) &= ~_BV(conf->en_i);
+		_delay_us(0.340);
+		
+		/* Low-order nibble (address counter) is read but ignored: */
+		if (conf->dl == HD44780_L_FS_DL_4BIT) {
+			_hd44780_l_ec(conf);
+		}
+	} while (busy && --max_polls);
+	
+	/* Take the data bus back: */
+	_hd44780_l_fb(conf->rw_port, conf->rw_i, 0);
+	_hd44780_l_dd(conf, 1);
+}
+
 /**
  * HD44780 device function.
  *
@@ -88,122 +222,147 @@ static inline void _hd44780_l_ec(const struct hd44780_l_conf* conf) {
  * @param rs		RS pin value
  * @param rw		R/W pin value
  * @param db		Data (DB7 down to DB0)
- * @param w_us		Number of s to wait after
+ * @param w_us		Number of s to wait after (max. if polling BF),
+ *			0 not to wait at all
  */
 static void _hd44780_l_func(const struct hd44780_l_conf* conf,
 uint8_t rs, uint8_t rw, uint8_t db, uint16_t w_us) {
 	uint16_t i;
 	
+	conf = _HD44780_L_CONF(conf);
+	
 	/* Fix RS and R/W: */
 	_hd44780_l_fb(conf->rs_port, conf->rs_i, rs);
 	_hd44780_l_fb(conf->rw_port, conf->rw_i, rw);
 	
-	/* Fix DB7 downto DB4: */
-	_hd44780_l_fb(conf->db7_port, conf->db7_i, db & _BV(7));
-	_hd44780_l_fb(conf->db6_port, conf->db6_i, db & _BV(6));
-	_hd44780_l_fb(conf->db5_port, conf->db5_i, db & _BV(5));
-	_hd44780_l_fb(conf->db4_port, conf->db4_i, db & _BV(4));
-	
-	/* Write high-order bits first if configured as 4-bit data length: */
-	if (conf->dl == HD44780_L_FS_DL_4BIT) {
-		/* EN cycle: */
-		_hd44780_l_ec(conf);
-	}
-	
-	/* Fix DB3 downto DB0: */
-	if (conf->dl == HD44780_L_FS_DL_8BIT) {
-		_hd44780_l_fb(conf->db3_port, conf->db3_i, db & _BV(3));
-		_hd44780_l_fb(conf->db2_port, conf->db2_i, db & _BV(2));
-		_hd44780_l_fb(conf->db1_port, conf->db1_i, db & _BV(1));
-		_hd44780_l_fb(conf->db0_port, conf->db0_i, db & _BV(0));
+	/* Whole byte in a single store if DB7 downto DB0 are wired in order: */
+	if (_HD44780_L_ORDERED(conf)) {
+		*(conf->db0_port) = db;
 	} else {
-		_hd44780_l_fb(conf->db7_port, conf->db7_i, db & _BV(3));
-		_hd44780_l_fb(conf->db6_port, conf->db6_i, db & _BV(2));
-		_hd44780_l_fb(conf->db5_port, conf->db5_i, db & _BV(1));
-		_hd44780_l_fb(conf->db4_port, conf->db4_i, db & _BV(0));	
+		/* Fix DB7 downto DB4: */
+		_hd44780_l_fb(conf->db7_port, conf->db7_i, db & _BV(7));
+		_hd44780_l_fb(conf->db6_port, conf->db6_i, db & _BV(6));
+		_hd44780_l_fb(conf->db5_port, conf->db5_i, db & _BV(5));
+		_hd44780_l_fb(conf->db4_port, conf->db4_i, db & _BV(4));
+		
+		/* Write high-order bits first if configured as 4-bit data length: */
+		if (conf->dl == HD44780_L_FS_DL_4BIT) {
+			/* EN cycle: */
+			_hd44780_l_ec(conf);
+		}
+		
+		/* Fix DB3 downto DB0: */
+		if (conf->dl == HD44780_L_FS_DL_8BIT) {
+			_hd44780_l_fb(conf->db3_port, conf->db3_i, db & _BV(3));
+			_hd44780_l_fb(conf->db2_port, conf->db2_i, db & _BV(2));
+			_hd44780_l_fb(conf->db1_port, conf->db1_i, db & _BV(1));
+			_hd44780_l_fb(conf->db0_port, conf->db0_i, db & _BV(0));
+		} else {
+			_hd44780_l_fb(conf->db7_port, conf->db7_i, db & _BV(3));
+			_hd44780_l_fb(conf->db6_port, conf->db6_i, db & _BV(2));
+			_hd44780_l_fb(conf->db5_port, conf->db5_i, db & _BV(1));
+			_hd44780_l_fb(conf->db4_port, conf->db4_i, db & _BV(0));	
+		}
 	}
 	
 	/* EN cycle: */
 	_hd44780_l_ec(conf);
 	
-	/* Wait after function: */
-	for (i = 0; i < w_us; ++i) {
-		_delay_us(1.0);
+	/* Wait after function (unless paced by the caller): */
+	if (w_us == 0) {
+		return;
+	} else if (conf->bf == HD44780_L_BF_POLL) {
+		_hd44780_l_wait_bf(conf, w_us);
+	} else {
+		for (i = 0; i < w_us; ++i) {
+			_delay_us(1.0);
+		}
 	}
 }
 
 void hd44780_l_clear_disp(const struct hd44780_l_conf* conf) {
-	_hd44780_l_func(conf, 0, 0, _BV(0), 1640);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_CLEAR_DISP, HD44780_L_T_LONG_US);
 }
 
 void hd44780_l_return_home(const struct hd44780_l_conf* conf) {
-	_hd44780_l_func(conf, 0, 0, _BV(1), 1640);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_RETURN_HOME, HD44780_L_T_LONG_US);
 }
 
 void hd44780_l_ems(const struct hd44780_l_conf* conf, uint8_t id, uint8_t s) {
-	_hd44780_l_func(conf, 0, 0, (_BV(2) | (id << 1) | s), 40);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_EMS(id, s), HD44780_L_T_SHORT_US);
 }
 
 void hd44780_l_disp(const struct hd44780_l_conf* conf, uint8_t d, uint8_t c,
 uint8_t b) {
-	_hd44780_l_func(conf, 0, 0, (_BV(3) | (d << 2) | (c << 1) | b), 40);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_DISP(d, c, b),
+		HD44780_L_T_SHORT_US);
 }
 
 void hd44780_l_cds(const struct hd44780_l_conf* conf, uint8_t sc, uint8_t rl) {
-	_hd44780_l_func(conf, 0, 0, (_BV(4) | (sc << 3) | (rl << 2)), 40);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_CDS(sc, rl), HD44780_L_T_SHORT_US);
 }
 
 void hd44780_l_fs(const struct hd44780_l_conf* conf, uint8_t dl, uint8_t n,
 uint8_t f) {
-	_hd44780_l_func(conf, 0, 0,
-		(_BV(5) | (dl << 4) | (n << 3) | (f << 2)), 40);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_FS(dl, n, f), HD44780_L_T_SHORT_US);
 }
 
 void hd44780_l_set_cgram_addr(const struct hd44780_l_conf* conf, uint8_t addr) {
-	_hd44780_l_func(conf, 0, 0, ((_BV(6) | addr) & ~_BV(7)), 40);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_CGRAM(addr), HD44780_L_T_SHORT_US);
 }
 
 void hd44780_l_set_ddram_addr(const struct hd44780_l_conf* conf, uint8_t addr) {
-	_hd44780_l_func(conf, 0, 0, (_BV(7) | addr), 40);
+	_hd44780_l_func(conf, 0, 0, HD44780_L_I_DDRAM(addr), HD44780_L_T_SHORT_US);
 }
 
 void hd44780_l_write(const struct hd44780_l_conf* conf, uint8_t data) {
-	_hd44780_l_func(conf, 1, 0, data, 45);
+	_hd44780_l_func(conf, 1, 0, data, HD44780_L_T_WRITE_US);
+}
+
+void hd44780_l_send(const struct hd44780_l_conf* conf, uint8_t rs, uint8_t db,
+uint16_t w_us) {
+	_hd44780_l_func(conf, rs, 0, db, w_us);
 }
 
 void hd44780_l_init(const struct hd44780_l_conf* conf, uint8_t n, uint8_t f,
 uint8_t id, uint8_t s) {
+	const struct hd44780_l_conf* pins = _HD44780_L_CONF(conf);
+	
 	/* Wait after Vcc rises: */
 	_delay_ms(15.0);
 	
 	/* Clear all pins: */
-	_hd44780_l_ca(conf);
+	_hd44780_l_ca(pins);
 	
 	/* Special function set (for data length): */
-	*(conf->db5_port) |= _BV(conf->db5_i);
-	*(conf->db4_port) |= _BV(conf->db4_i);
-	_hd44780_l_ec(conf);
+	*(pins->db5_port) |= _BV(pins->db5_i);
+	*(pins->db4_port) |= _BV(pins->db4_i);
+	_hd44780_l_ec(pins);
 	
 	/* Wait again: */
 	_delay_ms(4.1);
 	
 	/* Special function set (for data length): */
-	_hd44780_l_ec(conf);
+	_hd44780_l_ec(pins);
 	
 	/* Wait again: */
 	_delay_us(100.0);
 	
 	/* Special function set (for data length): */
-	_hd44780_l_ec(conf);
+	_hd44780_l_ec(pins);
+	
+	/* BF can be checked from here on, but the device is still busy: */
+	_delay_us(HD44780_L_T_SHORT_US);
 	
 	/* 4-bit specific: */
-	if (conf->dl == HD44780_L_FS_DL_4BIT) {
-		*(conf->db4_port) &= ~_BV(conf->db4_i);
-		_hd44780_l_ec(conf);
+	if (pins->dl == HD44780_L_FS_DL_4BIT) {
+		*(pins->db4_port) &= ~_BV(pins->db4_i);
+		_hd44780_l_ec(pins);
+		_delay_us(HD44780_L_T_SHORT_US);
 	}
 	
 	/* Remaining process: */
-	hd44780_l_fs(conf, conf->dl, n, f);
+	hd44780_l_fs(conf, pins->dl, n, f);
 	hd44780_l_disp(conf, HD44780_L_DISP_D_OFF, HD44780_L_DISP_C_OFF,
 		HD44780_L_DISP_B_OFF);
 	hd44780_l_clear_disp(conf);
@@ -52,6 +52,31 @@ Bit definitions for HD44780 functions.
 #define HD44780_L_FS_F_510	1	/* 5 * 10 dots character font */
 #define HD44780_L_FS_F_58	0	/* 5 * 8 dots character font */
 
+/*
+Instruction codes (DB7 downto DB0) of HD44780 functions.
+*/
+#define HD44780_L_I_CLEAR_DISP		_BV(0)
+#define HD44780_L_I_RETURN_HOME		_BV(1)
+#define HD44780_L_I_EMS(id, s)		(_BV(2) | ((id) << 1) | (s))
+#define HD44780_L_I_DISP(d, c, b)	(_BV(3) | ((d) << 2) | ((c) << 1) | (b))
+#define HD44780_L_I_CDS(sc, rl)		(_BV(4) | ((sc) << 3) | ((rl) << 2))
+#define HD44780_L_I_FS(dl, n, f)	(_BV(5) | ((dl) << 4) | ((n) << 3) | ((f) << 2))
+#define HD44780_L_I_CGRAM(addr)		((_BV(6) | (addr)) & ~_BV(7))
+#define HD44780_L_I_DDRAM(addr)		(_BV(7) | (addr))
+
+/*
+Worst-case execution times (us) of HD44780 functions.
+*/
+#define HD44780_L_T_SHORT_US	40	/* Most instructions */
+#define HD44780_L_T_WRITE_US	45	/* Data write */
+#define HD44780_L_T_LONG_US	1640	/* Clear display and return home */
+
+/*
+Busy flag handling (refer to configuration structure).
+*/
+#define HD44780_L_BF_WAIT	0	/* Wait worst-case execution time */
+#define HD44780_L_BF_POLL	1	/* Poll BF over R/W (must be wired) */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -86,6 +111,7 @@ struct hd44780_l_conf {
 	uint8_t line1_base_addr;	/* Line 1 base address */
 	uint8_t line2_base_addr;	/* Line 2 base address (if exists) */
 	uint8_t dl;			/* Data length (refer to bit defs.) */
+	uint8_t bf;			/* Busy flag handling (refer to defs.) */
 };
 
 /**
@@ -166,9 +192,27 @@ void hd44780_l_set_ddram_addr(const struct hd44780_l_conf* conf, uint8_t addr);
  */
 void hd44780_l_write(const struct hd44780_l_conf* conf, uint8_t data);
 
+/**
+ * Sends a raw instruction or data byte.
+ *
+ * Used to drive the device from an interrupt handler: with w_us set to 0,
+ * this returns right after the bus cycle and the caller has to let the
+ * instruction's execution time elapse before sending the next one.
+ *
+ * @param conf		HD44780 configuration
+ * @param rs		RS pin value (0: instruction, 1: data)
+ * @param db		Instruction code or data (8-bit)
+ * @param w_us		Number of us to wait after (0 not to wait)
+ */
+void hd44780_l_send(const struct hd44780_l_conf* conf, uint8_t rs, uint8_t db,
+	uint16_t w_us);
+
 /**
  * Initializes device according to HD44780 configuration's data length.
  *
+ * If DB7 downto DB0 are wired in order to a single AVR port, every byte is
+ * written with a single port store.
+ *
  * @param conf		HD44780 configuration
  * @param n		Number of display lines
  * @param f		Character font
@@ -19,33 +19,379 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "hd44780fw.h"
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "libcustomprocs/customprocs.h"
 #include "lib44780/hd44780_low.h"
 
+/* Queued operation flags: */
+#define _HD44780FW_OP_CMD   0x00 /* Instruction   */
+#define _HD44780FW_OP_DATA  0x01 /* Data (RS set) */
+
+/* Reads a byte from program space or data space: */
+#define _HD44780FW_RD(p, pgm) \
+	((pgm) ? pgm_read_byte(p) : *(const uint8_t*) (p))
+
+/* Keeps the compiler from moving the copy of a queue entry across the */
+/* read or the update of the index that hands it over to the other side */
+#define _HD44780FW_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+/* Queue entries a flush keeps free to restore blink/cursor at its end: */
+#define _HD44780FW_FL_RESERVE   2
+
+/**
+ * Gets the number of entries that can still be queued.
+ *
+ * @param conf      HD44780 framework configuration
+ * @return          Free queue entries (0xff when writes are synchronous)
+ */
+static uint8_t _hd44780fw_q_room(const struct hd44780fw_conf* conf) {
+	if (conf->q_start == 0) {
+		return 0xff;
+	}
+	return (conf->q_tail - conf->q_head - 1) & (HD44780FW_Q_SIZE - 1);
+}
+
+/**
+ * Outputs an instruction or data byte, through the queue if enabled.
+ *
+ * When the queue is full, this waits for the service to make room.  The
+ * flush, which writes the most, checks the room first so it never waits.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param op        Operation flags
+ * @param db        Instruction code or data
+ */
+static void _hd44780fw_out(struct hd44780fw_conf* conf, uint8_t op,
+uint8_t db) {
+	uint8_t head, next;
+
+	if (conf->q_start == 0) {
+		hd44780_l_send(conf->low_conf, op & _HD44780FW_OP_DATA, db,
+			HD44780_L_T_WRITE_US);
+		return;
+	}
+
+	head = conf->q_head;
+	next = (head + 1) & (HD44780FW_Q_SIZE - 1);
+	while (next == conf->q_tail);
+
+	conf->q_op[head] = op;
+	conf->q_db[head] = db;
+	_HD44780FW_BARRIER();
+	conf->q_head = next;
+	conf->q_start();
+}
+
+/**
+ * Gets the DDRAM column of a position, display shift included.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Position on device
+ * @return          DDRAM column in the position's line
+ */
+static uint8_t _hd44780fw_col(const struct hd44780fw_conf* conf,
+uint8_t index) {
+	if (index >= conf->half_chars) {
+		index -= conf->half_chars;
+	}
+	index += conf->shift;
+	if (index >= HD44780FW_LINE_CELLS) {
+		index -= HD44780FW_LINE_CELLS;
+	}
+
+	return index;
+}
+
+/**
+ * Gets the shadow char of a position.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Position on device
+ * @return          Shadow char
+ */
+static char* _hd44780fw_at(struct hd44780fw_conf* conf, uint8_t index) {
+	const uint8_t col = _hd44780fw_col(conf, index);
+
+	return &conf->shadow[index >= conf->half_chars][col];
+}
+
+/**
+ * Gets the DDRAM address of a line column.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param line      Line (0 or 1)
+ * @param col       DDRAM column
+ * @return          DDRAM address
+ */
+static uint8_t _hd44780fw_line_addr(const struct hd44780fw_conf* conf,
+uint8_t line, uint8_t col) {
+	return col + (line ? conf->low_conf->line2_base_addr :
+		conf->low_conf->line1_base_addr);
+}
+
+/**
+ * Gets the DDRAM address of a position.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Position on device
+ * @return          DDRAM address
+ */
+static uint8_t _hd44780fw_addr(const struct hd44780fw_conf* conf,
+uint8_t index) {
+	return _hd44780fw_line_addr(conf, index >= conf->half_chars,
+		_hd44780fw_col(conf, index));
+}
+
+/**
+ * Puts the marquee text char that goes at a column of the visible window.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param i         Column from the left edge (0 to HD44780FW_LINE_CELLS - 1)
+ */
+static void _hd44780fw_mq_put(struct hd44780fw_conf* conf, uint8_t i) {
+	uint8_t col = conf->shift + i;
+
+	if (col >= HD44780FW_LINE_CELLS) {
+		col -= HD44780FW_LINE_CELLS;
+	}
+	conf->shadow[conf->mq_line][col] = _HD44780FW_RD(
+		&conf->mq_msg[(conf->mq_pos + i) % conf->mq_len], conf->mq_pgm);
+}
+
+/**
+ * Sends display on/off control for current blink/cursor states, unless
+ * that is what the device already has.
+ *
+ * @param conf      HD44780 framework configuration
+ */
+static void _hd44780fw_disp(struct hd44780fw_conf* conf) {
+	const uint8_t disp = HD44780_L_I_DISP(HD44780_L_DISP_D_ON,
+		conf->cur_en ? HD44780_L_DISP_C_ON : HD44780_L_DISP_C_OFF,
+		conf->blink_en ? HD44780_L_DISP_B_ON : HD44780_L_DISP_B_OFF);
+
+	if (disp != conf->disp_sent) {
+		_hd44780fw_out(conf, _HD44780FW_OP_CMD, disp);
+		conf->disp_sent = disp;
+	}
+}
+
+/**
+ * Marks a custom character as the most recently used.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param slot      Custom character position (0 to 7)
+ */
+static void _hd44780fw_cc_touch(struct hd44780fw_conf* conf, uint8_t slot) {
+	uint8_t i = 0;
+
+	while (conf->cc_order[i] != slot) {
+		++i;
+	}
+	for (; i > 0; --i) {
+		conf->cc_order[i] = conf->cc_order[i - 1];
+	}
+	conf->cc_order[0] = slot;
+}
+
+/**
+ * Checks if a custom character already holds given pixel rows.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param slot      Custom character position (0 to 7)
+ * @param rows      Custom character pixel rows
+ * @param pgm       Rows are in program space
+ * @return          1 if the device has these rows at this position
+ */
+static uint8_t _hd44780fw_cc_same(const struct hd44780fw_conf* conf,
+uint8_t slot, const uint8_t* rows, uint8_t pgm) {
+	uint8_t i;
+
+	if (!(conf->cc_valid & _BV(slot))) {
+		return 0;
+	}
+	for (i = 0; i < 8; ++i) {
+		if (conf->cc_rows[slot][i] != _HD44780FW_RD(&rows[i], pgm)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Checks if a custom character is displayed or about to be.
+ *
+ * The whole marquee line counts, as the display shift brings its off screen
+ * chars into view.  The other line only counts where visible: its chars are
+ * moved along with the shift, so the off screen ones are never shown again.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param slot      Custom character position (0 to 7)
+ * @return          1 if used on display
+ */
+static uint8_t _hd44780fw_cc_shown(const struct hd44780fw_conf* conf,
+uint8_t slot) {
+	uint8_t i, line, col, col_sent;
+
+	for (line = 0; line < 2; ++line) {
+		for (i = 0; i < HD44780FW_LINE_CELLS; ++i) {
+			if (conf->mq_len == 0 || line != conf->mq_line) {
+				if (i >= conf->half_chars) {
+					break;
+				}
+				col = i + conf->shift;
+				col_sent = i + conf->shift_sent;
+				if (col >= HD44780FW_LINE_CELLS) {
+					col -= HD44780FW_LINE_CELLS;
+				}
+				if (col_sent >= HD44780FW_LINE_CELLS) {
+					col_sent -= HD44780FW_LINE_CELLS;
+				}
+			} else {
+				col = col_sent = i;
+			}
+
+			/* Character codes 8 to 15 are aliases of 0 to 7: */
+			if (((uint8_t) conf->shadow[line][col] & 0xf7) == slot ||
+				((uint8_t) conf->lcd[line][col_sent] & 0xf7) == slot) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Writes an array with length at given position.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param msg       Array to be written
+ * @param msg_len   Length of the array to write
+ * @param index     Position of first character on device
+ * @param cb        Clear display before writing string
+ * @param pgm       Array is in program space
+ */
+static void _hd44780fw_write_len(struct hd44780fw_conf* conf,
+const char* msg, uint8_t msg_len, uint8_t index, uint8_t cb, uint8_t pgm) {
+	uint8_t i;
+
+	/* Frequently used constants: */
+	const uint8_t total_chars = conf->total_chars;
+	const uint8_t half_chars = conf->half_chars;
+
+	if (cb) {
+		hd44780fw_clear(conf);
+	}
+	if (index >= total_chars || total_chars - index < msg_len) {
+		return;
+	}
+	for (i = 0; i < msg_len; ++i) {
+		*_hd44780fw_at(conf, index + i) = _HD44780FW_RD(&msg[i], pgm);
+	}
+
+	/* Account for what writing through would have cost: */
+	conf->fl_req += msg_len + 1;
+	if (index < half_chars && index + msg_len > half_chars) {
+		++conf->fl_req;
+	}
+
+	/* Fix v. cursor: */
+	conf->last_index = index + msg_len;
+}
+
 void hd44780fw_init(struct hd44780fw_conf* conf) {
+	uint8_t i;
+
 	/* Structure initialization */
+	if (conf->total_chars > HD44780FW_MAX_CHARS) {
+		conf->total_chars = HD44780FW_MAX_CHARS;
+	}
 	conf->half_chars = conf->total_chars / 2;
 	conf->blink_en = HD44780FW_DEF_BLINK_ST;
 	conf->cur_en = HD44780FW_DEF_CUR_ST;
 	conf->last_index = 0;
 	conf->last_bc_index = 0;
+	conf->q_head = 0;
+	conf->q_tail = 0;
+	conf->fl_req = 0;
+	conf->fl_left = 0;
+	conf->fl_avoided = 0;
+	conf->shift = 0;
+	conf->shift_sent = 0;
+	conf->mq_len = 0;
+	conf->cc_valid = 0;
+	for (i = 0; i < HD44780FW_CC_COUNT; ++i) {
+		conf->cc_order[i] = i;
+	}
+	for (i = 0; i < HD44780FW_LINE_CELLS; ++i) {
+		conf->shadow[0][i] = ' ';
+		conf->shadow[1][i] = ' ';
+		conf->lcd[0][i] = ' ';	/* Cleared by device initialization */
+		conf->lcd[1][i] = ' ';
+	}
 
 	/* Device initialization: */
 	hd44780_l_init(conf->low_conf, conf->lines, conf->font,
 		HD44780_L_EMS_ID_INC, HD44780_L_EMS_S_OFF);
 
 	/* Turn on display and set blink/cursor according to default values: */
-	hd44780_l_disp(conf->low_conf, HD44780_L_DISP_D_ON,
-		HD44780FW_DEF_CUR_ST, HD44780FW_DEF_BLINK_ST);
+	conf->disp_sent = HD44780_L_I_DISP(HD44780_L_DISP_D_OFF,
+		HD44780_L_DISP_C_OFF, HD44780_L_DISP_B_OFF);
+	_hd44780fw_disp(conf);
+}
+
+uint8_t hd44780fw_q_service(struct hd44780fw_conf* conf) {
+	uint8_t tail = conf->q_tail;
+	uint8_t burst;
+
+	if (tail == conf->q_head) {
+		return 0;
+	}
+	_HD44780FW_BARRIER();
+
+	/* The last byte of a burst has until the next service to complete: */
+	for (burst = HD44780FW_Q_BURST; burst > 0 && tail != conf->q_head;
+		--burst) {
+		hd44780_l_send(conf->low_conf, conf->q_op[tail] & _HD44780FW_OP_DATA,
+			conf->q_db[tail], burst > 1 ? HD44780_L_T_WRITE_US : 0);
+		tail = (tail + 1) & (HD44780FW_Q_SIZE - 1);
+	}
+	_HD44780FW_BARRIER();
+	conf->q_tail = tail;
+
+	return 1;
 }
 
 void hd44780fw_fini(struct hd44780fw_conf* conf) {
 }
 
 void hd44780fw_put(struct hd44780fw_conf* conf, char ch) {
-	hd44780fw_cat_char(conf, ch);
+	if (conf->last_index >= conf->total_chars) {
+		return;
+	}
+	*_hd44780fw_at(conf, conf->last_index++) = ch;
+	++conf->fl_req;
+}
+
+void hd44780fw_begin(struct hd44780fw_conf* conf, uint8_t index) {
+	if (index < conf->total_chars) {
+		conf->last_index = index;
+		++conf->fl_req; /* Address */
+	}
+}
+
+void hd44780fw_put_len(struct hd44780fw_conf* conf, const char* msg,
+uint8_t msg_len) {
+	while (msg_len--) {
+		hd44780fw_put(conf, *msg++);
+	}
+}
+
+uint16_t hd44780fw_end(struct hd44780fw_conf* conf) {
+	return hd44780fw_flush(conf);
 }
 
 void hd44780fw_write(struct hd44780fw_conf* conf, const char* msg,
@@ -55,113 +401,308 @@ uint8_t index, uint8_t cb) {
     hd44780fw_write_len(conf, msg, msg_len, index, cb);
 }
 
+void hd44780fw_write_P(struct hd44780fw_conf* conf, const char* msg,
+uint8_t index, uint8_t cb) {
+    uint8_t msg_len = strlen_P(msg);
+
+    hd44780fw_write_len_P(conf, msg, msg_len, index, cb);
+}
+
 void hd44780fw_write_len(struct hd44780fw_conf* conf, const char* msg,
 uint8_t msg_len, uint8_t index, uint8_t cb) {
-	uint8_t up_len = 0, i;
+	_hd44780fw_write_len(conf, msg, msg_len, index, cb, 0);
+}
 
-	/* Disable blink while appending chars: */
-	const uint8_t blink_en_bkup = conf->blink_en;
-	const uint8_t cur_en_bkup = conf->cur_en;
-	hd44780fw_en_blink(conf, HD44780_L_DISP_B_OFF);
-	hd44780fw_en_cursor(conf, HD44780_L_DISP_C_OFF);
+void hd44780fw_write_len_P(struct hd44780fw_conf* conf, const char* msg,
+uint8_t msg_len, uint8_t index, uint8_t cb) {
+	_hd44780fw_write_len(conf, msg, msg_len, index, cb, 1);
+}
+
+uint16_t hd44780fw_flush(struct hd44780fw_conf* conf) {
+	uint8_t i, line, next, full = 0;
+	uint16_t sent = 0, avoided = 0;
 
 	/* Frequently used constants: */
-	const uint8_t line1_base_addr = conf->low_conf->line1_base_addr;
-	const uint8_t line2_base_addr = conf->low_conf->line2_base_addr;
-	const uint8_t total_chars = conf->total_chars;
-	const uint8_t half_chars = conf->half_chars;
+	const uint8_t blink_en_bkup = conf->blink_en;
+	const uint8_t cur_en_bkup = conf->cur_en;
 
-	if (cb) {
-		hd44780fw_clear(conf);
+	/* Nothing written since the last flush, and nothing left over by it: */
+	if (conf->fl_req == 0 && !conf->fl_left) {
+		return 0;
 	}
-	if (index >= total_chars || total_chars - index < msg_len) {
-		return;
-	}
-	if (index < half_chars) {
-		if (msg_len + index < line1_base_addr + half_chars) {
-			up_len = msg_len;
-		} else {
-			up_len = half_chars - index;
-		}
-		hd44780_l_set_ddram_addr(conf->low_conf, index + line1_base_addr);
-		for (i = 0; i < up_len; ++i) {
-			hd44780_l_write(conf->low_conf, msg[i]);
+
+	for (line = 0; line < 2 && !full; ++line) {
+		next = 0xff;
+		for (i = 0; i < HD44780FW_LINE_CELLS && !full; ++i) {
+			if (conf->shadow[line][i] == conf->lcd[line][i]) {
+				continue;
+			}
+			/* Queue full: the rest still differs and goes next flush */
+			if (_hd44780fw_q_room(conf) < 3 + _HD44780FW_FL_RESERVE) {
+				full = 1;
+				continue;
+			}
+			if (sent == 0) {
+				/* Disable blink while updating chars: */
+				conf->blink_en = HD44780_L_DISP_B_OFF;
+				conf->cur_en = HD44780_L_DISP_C_OFF;
+				_hd44780fw_disp(conf);
+			}
+
+			/* Address only needed where a run of changed chars starts: */
+			if (i != next) {
+				_hd44780fw_out(conf, _HD44780FW_OP_CMD, HD44780_L_I_DDRAM(
+					_hd44780fw_line_addr(conf, line, i)));
+				++sent;
+			}
+			_hd44780fw_out(conf, _HD44780FW_OP_DATA,
+				conf->shadow[line][i]);
+			conf->lcd[line][i] = conf->shadow[line][i];
+			++sent;
+			next = i + 1;
 		}
-		hd44780_l_set_ddram_addr(conf->low_conf, line2_base_addr);
-		for (i = up_len; i < msg_len; ++i) {
-			hd44780_l_write(conf->low_conf, msg[i]);
+	}
+
+	/* Only the marquee shifts the display, one char to the left per step: */
+	while (!full && conf->shift_sent != conf->shift) {
+		if (_hd44780fw_q_room(conf) < 1 + _HD44780FW_FL_RESERVE) {
+			full = 1;
+			break;
 		}
-	} else {
-		hd44780_l_set_ddram_addr(conf->low_conf,
-			index + line2_base_addr - half_chars);
-		for (i = 0; i < msg_len; ++i) {
-			hd44780_l_write(conf->low_conf, msg[i]);
+		_hd44780fw_out(conf, _HD44780FW_OP_CMD,
+			HD44780_L_I_CDS(HD44780_L_CDS_SC_SHIFT, HD44780_L_CDS_RL_LEFT));
+		if (++conf->shift_sent == HD44780FW_LINE_CELLS) {
+			conf->shift_sent = 0;
 		}
+		++sent;
 	}
 
-	/* Enable last blink/cursor state: */
-	hd44780fw_set_bc_index(conf, conf->last_bc_index);
-	hd44780fw_en_blink(conf, blink_en_bkup);
-	hd44780fw_en_cursor(conf, cur_en_bkup);
+	if (sent && (blink_en_bkup || cur_en_bkup)) {
+		/* Enable last blink/cursor state: */
+		hd44780fw_set_bc_index(conf, conf->last_bc_index);
+		conf->blink_en = blink_en_bkup;
+		conf->cur_en = cur_en_bkup;
+		_hd44780fw_disp(conf);
+	}
 
-	/* Fix v. cursor: */
-	conf->last_index = index + msg_len;
+	if (conf->fl_req > sent) {
+		avoided = conf->fl_req - sent;
+	}
+	conf->fl_req = 0;
+	conf->fl_left = full;
+	conf->fl_avoided += avoided;
+
+	return avoided;
+}
+
+/**
+ * Starts scrolling a text on a line.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param msg       Text to loop
+ * @param msg_len   Length of the text
+ * @param line      Line to scroll (0 or 1)
+ * @param pgm       Text is in program space
+ */
+static void _hd44780fw_marquee(struct hd44780fw_conf* conf, const char* msg,
+uint8_t msg_len, uint8_t line, uint8_t pgm) {
+	uint8_t i;
+
+	if (conf->lines != HD44780_L_FS_N_DUAL || msg_len == 0 || line > 1) {
+		return;
+	}
+	conf->mq_msg = msg;
+	conf->mq_pgm = pgm;
+	conf->mq_len = msg_len;
+	conf->mq_line = line;
+	conf->mq_pos = 0;
+
+	/* Loop the text over the whole line, visible or not: */
+	for (i = 0; i < HD44780FW_LINE_CELLS; ++i) {
+		_hd44780fw_mq_put(conf, i);
+	}
+	conf->fl_req += conf->half_chars + 1;
+}
+
+void hd44780fw_marquee(struct hd44780fw_conf* conf, const char* msg,
+uint8_t msg_len, uint8_t line) {
+	_hd44780fw_marquee(conf, msg, msg_len, line, 0);
+}
+
+void hd44780fw_marquee_P(struct hd44780fw_conf* conf, const char* msg,
+uint8_t msg_len, uint8_t line) {
+	_hd44780fw_marquee(conf, msg, msg_len, line, 1);
+}
+
+void hd44780fw_marquee_step(struct hd44780fw_conf* conf) {
+	uint8_t i, from, to;
+	char* const other = conf->shadow[!conf->mq_line];
+
+	if (conf->mq_len == 0) {
+		return;
+	}
+
+	/* Move the other line's visible chars along with the shift: */
+	from = _hd44780fw_col(conf, conf->half_chars - 1);
+	to = (from == HD44780FW_LINE_CELLS - 1) ? 0 : from + 1;
+	for (i = conf->half_chars; i > 0; --i) {
+		other[to] = other[from];
+		to = from;
+		from = (from == 0) ? HD44780FW_LINE_CELLS - 1 : from - 1;
+	}
+	other[to] = conf->lcd[!conf->mq_line][to]; /* Now off screen */
+
+	if (++conf->shift == HD44780FW_LINE_CELLS) {
+		conf->shift = 0;
+	}
+	if (++conf->mq_pos == conf->mq_len) {
+		conf->mq_pos = 0;
+	}
+
+	/* The column that went off screen comes back last: */
+	_hd44780fw_mq_put(conf, HD44780FW_LINE_CELLS - 1);
+
+	/* Scrolling by writing through would rewrite the visible text: */
+	conf->fl_req += conf->half_chars + 1;
 }
 
 void hd44780fw_clear(struct hd44780fw_conf* conf) {
-	hd44780_l_clear_disp(conf->low_conf); /* Device clear function */
+	uint8_t i;
+
+	for (i = 0; i < conf->total_chars; ++i) {
+		*_hd44780fw_at(conf, i) = ' ';
+	}
+	++conf->fl_req; /* Clear display */
+	conf->mq_len = 0;
 	conf->last_index = 0; /* Reinitialize v. cursor */
-	hd44780fw_set_bc_index(conf, 0);
+
+	/* The DDRAM address only matters to a shown blink/cursor: */
+	if (conf->blink_en || conf->cur_en) {
+		hd44780fw_set_bc_index(conf, 0);
+	} else {
+		conf->last_bc_index = 0;
+	}
 }
 
 void hd44780fw_en_blink(struct hd44780fw_conf* conf, uint8_t state) {
-	hd44780_l_disp(conf->low_conf, HD44780_L_DISP_D_ON,
-		conf->cur_en ? HD44780_L_DISP_C_ON : HD44780_L_DISP_C_OFF,
-		state ? HD44780_L_DISP_B_ON : HD44780_L_DISP_B_OFF);
 	conf->blink_en = state;
+	_hd44780fw_disp(conf);
 }
 
 void hd44780fw_en_cursor(struct hd44780fw_conf* conf, uint8_t state) {
-	hd44780_l_disp(conf->low_conf, HD44780_L_DISP_D_ON,
-		state ? HD44780_L_DISP_C_ON : HD44780_L_DISP_C_OFF,
-		conf->blink_en ? HD44780_L_DISP_B_ON : HD44780_L_DISP_B_OFF);
 	conf->cur_en = state;
+	_hd44780fw_disp(conf);
 }
 
 void hd44780fw_set_bc_index(struct hd44780fw_conf* conf, uint8_t index) {
-	const uint8_t line1_base_addr = conf->low_conf->line1_base_addr;
-	const uint8_t line2_base_addr = conf->low_conf->line2_base_addr;
-
 	if (index >= conf->total_chars) {
 		return;
 	}
 	conf->last_bc_index = index;
 
-	if (index < conf->half_chars) {
-		hd44780_l_set_ddram_addr(conf->low_conf,
-			index + line1_base_addr);
-	} else {
-		hd44780_l_set_ddram_addr(conf->low_conf,
-			index + line2_base_addr - conf->half_chars);
-	}
+	_hd44780fw_out(conf, _HD44780FW_OP_CMD,
+		HD44780_L_I_DDRAM(_hd44780fw_addr(conf, index)));
 }
 
-void hd44780fw_build_cc(struct hd44780fw_conf* conf, uint8_t index,
-const uint8_t* rows) {
-	uint8_t i;
-	uint8_t mult = (conf->font == HD44780_L_FS_F_58 ? 8 : 10);
+/**
+ * Builds consecutive custom characters the device does not already have.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Position of first custom character (0 to 7)
+ * @param count     Number of custom characters
+ * @param rows      Pixel rows of each custom character, one after the other
+ * @param pgm       Rows are in program space
+ */
+static void _hd44780fw_build_ccs(struct hd44780fw_conf* conf, uint8_t index,
+uint8_t count, const uint8_t* rows, uint8_t pgm) {
+	uint8_t i, row, slot, next = 0xff;
+
 	if (conf->font == HD44780_L_FS_F_510) {
 		return;		/* Not yet implemented */
 	}
-	if (index > 7) {
+	if (index > HD44780FW_CC_COUNT - count) {
 		return;
 	}
-	hd44780_l_set_cgram_addr(conf->low_conf, index * mult);
-	for (i = 0; i < mult; ++i) {
-		hd44780_l_write(conf->low_conf, rows[i]); /* Write cur. row */
+	for (slot = index; slot < index + count; ++slot, rows += 8) {
+		_hd44780fw_cc_touch(conf, slot);
+		if (_hd44780fw_cc_same(conf, slot, rows, pgm)) {
+			continue;	/* Already in CGRAM */
+		}
+
+		/* Address only needed where a run of uploaded chars starts: */
+		if (slot != next) {
+			_hd44780fw_out(conf, _HD44780FW_OP_CMD,
+				HD44780_L_I_CGRAM(slot * 8));
+		}
+		for (i = 0; i < 8; ++i) {
+			row = _HD44780FW_RD(&rows[i], pgm);
+			_hd44780fw_out(conf, _HD44780FW_OP_DATA, row); /* Write cur. row */
+			conf->cc_rows[slot][i] = row;
+		}
+		conf->cc_valid |= _BV(slot);
+		next = slot + 1;
 	}
 }
 
+/**
+ * Gets a custom character by its pixel rows, building it if needed.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param rows      Custom character pixel rows
+ * @param pgm       Rows are in program space
+ * @return          Custom character position (0 to 7), or HD44780FW_CC_NONE
+ */
+static uint8_t _hd44780fw_get_cc(struct hd44780fw_conf* conf,
+const uint8_t* rows, uint8_t pgm) {
+	uint8_t i, slot;
+
+	for (slot = 0; slot < HD44780FW_CC_COUNT; ++slot) {
+		if (_hd44780fw_cc_same(conf, slot, rows, pgm)) {
+			_hd44780fw_cc_touch(conf, slot);
+			return slot;
+		}
+	}
+
+	/* Evict the least recently used char that is not displayed: */
+	for (i = HD44780FW_CC_COUNT; i > 0; --i) {
+		slot = conf->cc_order[i - 1];
+		if (!_hd44780fw_cc_shown(conf, slot)) {
+			_hd44780fw_build_ccs(conf, slot, 1, rows, pgm);
+			return slot;
+		}
+	}
+
+	return HD44780FW_CC_NONE;	/* All displayed */
+}
+
+void hd44780fw_build_cc(struct hd44780fw_conf* conf, uint8_t index,
+const uint8_t* rows) {
+	_hd44780fw_build_ccs(conf, index, 1, rows, 0);
+}
+
+void hd44780fw_build_cc_P(struct hd44780fw_conf* conf, uint8_t index,
+const uint8_t* rows) {
+	_hd44780fw_build_ccs(conf, index, 1, rows, 1);
+}
+
+void hd44780fw_build_ccs(struct hd44780fw_conf* conf, uint8_t index,
+uint8_t count, const uint8_t* rows) {
+	_hd44780fw_build_ccs(conf, index, count, rows, 0);
+}
+
+void hd44780fw_build_ccs_P(struct hd44780fw_conf* conf, uint8_t index,
+uint8_t count, const uint8_t* rows) {
+	_hd44780fw_build_ccs(conf, index, count, rows, 1);
+}
+
+uint8_t hd44780fw_get_cc(struct hd44780fw_conf* conf, const uint8_t* rows) {
+	return _hd44780fw_get_cc(conf, rows, 0);
+}
+
+uint8_t hd44780fw_get_cc_P(struct hd44780fw_conf* conf, const uint8_t* rows) {
+	return _hd44780fw_get_cc(conf, rows, 1);
+}
+
 void hd44780fw_cat_string(struct hd44780fw_conf* conf, const char* msg) {
 	hd44780fw_write(conf, msg, conf->last_index, 0);
 }
@@ -185,9 +726,7 @@ void hd44780fw_cat_int8(struct hd44780fw_conf* conf, int8_t i) {
 }
 
 void hd44780fw_cat_char(struct hd44780fw_conf* conf, char ch) {
-	conf->buf[0] = ch;
-	conf->buf[1] = '\0';
-	hd44780fw_cat_string(conf, conf->buf);
+	hd44780fw_write_len(conf, &ch, 1, conf->last_index, 0);
 }
 
 void hd44780fw_rem(struct hd44780fw_conf* conf, uint8_t rem) {
@@ -198,7 +737,7 @@ void hd44780fw_rem(struct hd44780fw_conf* conf, uint8_t rem) {
 	}
 	conf->last_index -= rem;
 	for (i = 0; i < rem; ++i) {
-		hd44780fw_cat_char(conf, HD44780FW_DEF_REM_CHAR);
+		*_hd44780fw_at(conf, conf->last_index + i) = HD44780FW_DEF_REM_CHAR;
 	}
-	conf->last_index -= rem;
+	conf->fl_req += rem + 1;
 }
@@ -43,6 +43,33 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /* Local buffer size: */
 #define HD44780FW_BUF_SIZE  16
 
+/* DDRAM chars per line (dual line mode) and max. total chars on display: */
+#define HD44780FW_LINE_CELLS    40
+#define HD44780FW_MAX_CHARS     (2 * HD44780FW_LINE_CELLS)
+
+/* Number of custom characters (5 * 8 dots font): */
+#define HD44780FW_CC_COUNT  8
+
+/* Got instead of a custom character when all are displayed (a full block */
+/* in the character ROM, so that it still shows something):               */
+#define HD44780FW_CC_NONE   0xff
+
+/* Output queue size (power of 2): */
+#define HD44780FW_Q_SIZE        128
+
+/*
+ * Period at which the queue is serviced, and most bytes sent per service.
+ * Each byte of a service but the last is waited for (on BF if polled), so
+ * a service takes about HD44780FW_Q_BURST sends and BF reads, and the
+ * period has to stay well above that and the interrupt overhead.
+ */
+#ifndef HD44780FW_Q_TICK_US
+#define HD44780FW_Q_TICK_US     1024
+#endif
+#ifndef HD44780FW_Q_BURST
+#define HD44780FW_Q_BURST       4
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,17 +84,55 @@ struct hd44780fw_conf {
     uint8_t cur_en;                        /* Cursor state                    */
     uint8_t last_index;                    /* Last write index                */
     uint8_t last_bc_index;                 /* Last blink/cursor index         */
+    uint8_t disp_sent;                     /* Last display on/off control     */
     char buf [HD44780FW_BUF_SIZE];         /* Internal buffer                 */
+    char shadow [2][HD44780FW_LINE_CELLS]; /* Chars to display (DDRAM)        */
+    char lcd [2][HD44780FW_LINE_CELLS];    /* Chars in device DDRAM           */
+    uint8_t shift;                         /* Display shift to show           */
+    uint8_t shift_sent;                    /* Display shift of device         */
+    const char* mq_msg;                    /* Marquee text                    */
+    uint8_t mq_pgm;                        /* Marquee text in program space   */
+    uint8_t mq_len;                        /* Marquee text length (0: none)   */
+    uint8_t mq_line;                       /* Marquee line                    */
+    uint8_t mq_pos;                        /* Marquee text index at left edge */
+    uint16_t fl_req;                       /* Bus bytes written since flush   */
+    uint8_t fl_left;                       /* Flush left chars to send        */
+    uint32_t fl_avoided;                   /* Total bus bytes avoided         */
+    uint8_t cc_rows [HD44780FW_CC_COUNT][8]; /* Custom chars in CGRAM         */
+    uint8_t cc_valid;                      /* Custom chars known (bit/char)   */
+    uint8_t cc_order [HD44780FW_CC_COUNT]; /* Custom chars, most recent first */
     const struct hd44780_l_conf* low_conf; /* Low-level driver conf.          */
+    void (*q_start)(void);                 /* Starts queue service (or NULL)  */
+    volatile uint8_t q_head;               /* Queue write index               */
+    volatile uint8_t q_tail;               /* Queue read index                */
+    uint8_t q_op [HD44780FW_Q_SIZE];       /* Queued operations               */
+    uint8_t q_db [HD44780FW_Q_SIZE];       /* Queued instructions/data        */
 };
 
 /**
  * Initializes the framework and the device.
  *
+ * If q_start is set, everything written after initialization is queued
+ * and q_start is called so that hd44780fw_q_service gets called every
+ * HD44780FW_Q_TICK_US until the queue is empty.  Otherwise, the writes
+ * are made synchronously.
+ *
  * @param conf      HD44780 framework configuration
  */
 void hd44780fw_init(struct hd44780fw_conf* conf);
 
+/**
+ * Sends the next queued instructions or data bytes to the device, up to
+ * HD44780FW_Q_BURST of them.
+ *
+ * To be called from a timer interrupt every HD44780FW_Q_TICK_US.
+ *
+ * @param conf      HD44780 framework configuration
+ * @return          0 once the queue is empty and the device is ready,
+ *                  so that the service can be stopped
+ */
+uint8_t hd44780fw_q_service(struct hd44780fw_conf* conf);
+
 /**
  * Puts a single character at current v. cursor position.
  *
@@ -76,6 +141,37 @@ void hd44780fw_init(struct hd44780fw_conf* conf);
  */
 void hd44780fw_put(struct hd44780fw_conf* conf, char ch);
 
+/**
+ * Begins a streamed write at given position.
+ *
+ * Characters are then added with @see hd44780fw_put and
+ * @see hd44780fw_put_len, and sent all at once by @see hd44780fw_end.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Position of first character on device
+ */
+void hd44780fw_begin(struct hd44780fw_conf* conf, uint8_t index);
+
+/**
+ * Puts characters at current v. cursor position.
+ *
+ * Characters past the end of the display are dropped.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param msg       Array to put (may contain CGRAM character index 0)
+ * @param msg_len   Length of the array to put
+ */
+void hd44780fw_put_len(struct hd44780fw_conf* conf, const char* msg,
+    uint8_t msg_len);
+
+/**
+ * Ends a streamed write.
+ *
+ * @param conf      HD44780 framework configuration
+ * @return          @see hd44780fw_flush
+ */
+uint16_t hd44780fw_end(struct hd44780fw_conf* conf);
+
 /**
  * Writes a string at given position.
  *
@@ -90,6 +186,34 @@ void hd44780fw_put(struct hd44780fw_conf* conf, char ch);
 void hd44780fw_write(struct hd44780fw_conf* conf, const char* msg,
     uint8_t index, uint8_t cb);
 
+/**
+ * Writes a string from program space at given position.
+ *
+ * @see hd44780fw_write
+ *
+ * @param conf      HD44780 framework configuration
+ * @param msg       Null-terminated string in program space
+ * @param index     Position of first character on device
+ * @param cb        Clear display before writing string
+ */
+void hd44780fw_write_P(struct hd44780fw_conf* conf, const char* msg,
+    uint8_t index, uint8_t cb);
+
+/**
+ * Sends the chars that changed since the last flush to the device.
+ *
+ * The write functions only update a RAM shadow of the display; this has to
+ * be called for them to be shown.  A DDRAM address is sent only where a run
+ * of changed chars does not follow the previous one.  When the queue
+ * fills up, the chars left are sent by the next flush instead of waiting.
+ * When nothing was written since the last flush, this returns at once.
+ *
+ * @param conf      HD44780 framework configuration
+ * @return          Number of bus bytes avoided compared to writing every
+ *                  char and address since the last flush
+ */
+uint16_t hd44780fw_flush(struct hd44780fw_conf* conf);
+
 /**
  * Writes a string with length at given position.
  *
@@ -107,9 +231,65 @@ void hd44780fw_write(struct hd44780fw_conf* conf, const char* msg,
 void hd44780fw_write_len(struct hd44780fw_conf* conf, const char* msg,
     uint8_t msg_len, uint8_t index, uint8_t cb);
 
+/**
+ * Writes an array from program space with length at given position.
+ *
+ * @see hd44780fw_write_len
+ *
+ * @param conf      HD44780 framework configuration
+ * @param msg       Array in program space
+ * @param msg_len   Length of the array to write
+ * @param index     Position of first character on device
+ * @param cb        Clear display before writing string
+ */
+void hd44780fw_write_len_P(struct hd44780fw_conf* conf, const char* msg,
+    uint8_t msg_len, uint8_t index, uint8_t cb);
+
+/**
+ * Starts scrolling a text on a line.
+ *
+ * The text is looped over the whole DDRAM line, so that each
+ * @see hd44780fw_marquee_step is only a display shift, plus a char rewritten
+ * off screen when the text length does not divide HD44780FW_LINE_CELLS.
+ * The display shift moves both lines, so the other line's chars are moved
+ * along in DDRAM to stay in place, which costs a write for each visible
+ * char that differs from the one on its left.  A step is a single byte only
+ * while the other line is blank (or all the same char) and the text length
+ * divides HD44780FW_LINE_CELLS.  Only works in dual line mode.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param msg       Text to loop (must stay valid while scrolling)
+ * @param msg_len   Length of the text
+ * @param line      Line to scroll (0 or 1)
+ */
+void hd44780fw_marquee(struct hd44780fw_conf* conf, const char* msg,
+    uint8_t msg_len, uint8_t line);
+
+/**
+ * Starts scrolling a text from program space on a line.
+ *
+ * @see hd44780fw_marquee
+ *
+ * @param conf      HD44780 framework configuration
+ * @param msg       Text to loop, in program space
+ * @param msg_len   Length of the text
+ * @param line      Line to scroll (0 or 1)
+ */
+void hd44780fw_marquee_P(struct hd44780fw_conf* conf, const char* msg,
+    uint8_t msg_len, uint8_t line);
+
+/**
+ * Scrolls the marquee text one char to the left.
+ *
+ * @param conf      HD44780 framework configuration
+ */
+void hd44780fw_marquee_step(struct hd44780fw_conf* conf);
+
 /**
  * Clears display.
  *
+ * This also stops the marquee.
+ *
  * @param conf      HD44780 framework configuration
  */
 void hd44780fw_clear(struct hd44780fw_conf* conf);
@@ -141,6 +321,8 @@ void hd44780fw_set_bc_index(struct hd44780fw_conf* conf, uint8_t index);
 /**
  * Builds a custom character.
  *
+ * Nothing is sent if the device already has it at this position.
+ *
  * @param conf      HD44780 framework configuration
  * @param index     Custom character position (0 to 7)
  * @param rows      Custom character pixel rows
@@ -148,6 +330,72 @@ void hd44780fw_set_bc_index(struct hd44780fw_conf* conf, uint8_t index);
 void hd44780fw_build_cc(struct hd44780fw_conf* conf, uint8_t index,
     const uint8_t* rows);
 
+/**
+ * Builds a custom character from program space.
+ *
+ * @see hd44780fw_build_cc
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Custom character position (0 to 7)
+ * @param rows      Custom character pixel rows, in program space
+ */
+void hd44780fw_build_cc_P(struct hd44780fw_conf* conf, uint8_t index,
+    const uint8_t* rows);
+
+/**
+ * Builds consecutive custom characters.
+ *
+ * Only the characters the device does not already have are sent, and
+ * consecutive ones are sent after a single CGRAM address.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Position of first custom character (0 to 7)
+ * @param count     Number of custom characters
+ * @param rows      Pixel rows of each custom character, one after the other
+ */
+void hd44780fw_build_ccs(struct hd44780fw_conf* conf, uint8_t index,
+    uint8_t count, const uint8_t* rows);
+
+/**
+ * Builds consecutive custom characters from program space.
+ *
+ * @see hd44780fw_build_ccs
+ *
+ * @param conf      HD44780 framework configuration
+ * @param index     Position of first custom character (0 to 7)
+ * @param count     Number of custom characters
+ * @param rows      Pixel rows of each custom character, in program space
+ */
+void hd44780fw_build_ccs_P(struct hd44780fw_conf* conf, uint8_t index,
+    uint8_t count, const uint8_t* rows);
+
+/**
+ * Gets a custom character by its pixel rows.
+ *
+ * If no position has these rows yet, they are built in place of the least
+ * recently used custom character that is not displayed.  A displayed one
+ * is never replaced.
+ *
+ * @param conf      HD44780 framework configuration
+ * @param rows      Custom character pixel rows
+ * @return          Custom character position (0 to 7), to be written
+ *                  as a character code, or HD44780FW_CC_NONE if all are
+ *                  displayed
+ */
+uint8_t hd44780fw_get_cc(struct hd44780fw_conf* conf, const uint8_t* rows);
+
+/**
+ * Gets a custom character by its pixel rows, from program space.
+ *
+ * @see hd44780fw_get_cc
+ *
+ * @param conf      HD44780 framework configuration
+ * @param rows      Custom character pixel rows, in program space
+ * @return          Custom character position (0 to 7), or
+ *                  HD44780FW_CC_NONE
+ */
+uint8_t hd44780fw_get_cc_P(struct hd44780fw_conf* conf, const uint8_t* rows);
+
 /**
  * Concatenates a string at current v. cursor position.
  *
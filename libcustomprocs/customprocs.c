@@ -17,10 +17,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "customprocs.h"
 
+/* Powers of ten that fit in 32 bits: */
+static const uint32_t _cp_pow10[10] PROGMEM = {
+	1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+	100000000UL, 1000000000UL
+};
+
 /**
  * Absolute (unsigned) integer to ASCIIZ string - for internal use only.
  *
@@ -33,10 +40,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 static uint8_t _cp_abs_ntoa(char* buf, uint16_t val, uint8_t base,
 uint8_t init_i) {
 	uint8_t i = init_i;
+	uint16_t q;
+
 	if (val == 0) {
 		buf[i] = '0';
 		--i;
 	}
+	if (base == 10) {
+		/* val / 10 == (val * 0xcccd) >> 19 for any 16-bit val: */
+		for(; val && i; --i, val = q) {
+			q = (uint16_t) (((uint32_t) val * 0xcccdU) >> 19);
+			buf[i] = '0' + (uint8_t) (val - q * 10);
+		}
+		return i;
+	}
 	for(; val && i; --i, val /= base) {
 		buf[i] = CP_HEX_CHARLIST[val % base];
 	}
@@ -44,6 +61,57 @@ uint8_t init_i) {
 	return i;
 }
 
+/**
+ * Absolute (unsigned) long integer to ASCIIZ string - for internal use only.
+ *
+ * Base 10 digits are found by subtracting powers of ten, most significant
+ * first; digits that do not fit in the buffer are dropped.
+ *
+ * @param buf		Buffer to be used
+ * @param val		Value
+ * @param base		Base (between 2 and 16)
+ * @param init_i	Initial position inside buffer for the algorithm
+ * @return		Position of string inside given buffer
+ */
+static uint8_t _cp_abs_lntoa(char* buf, uint32_t val, uint8_t base,
+uint8_t init_i) {
+	uint8_t i = init_i;
+	uint8_t k = 9, top;
+	uint32_t p;
+	char d;
+
+	if (base != 10) {
+		if (val == 0) {
+			buf[i] = '0';
+			--i;
+		}
+		for(; val && i; --i, val /= base) {
+			buf[i] = CP_HEX_CHARLIST[val % base];
+		}
+		return i;
+	}
+
+	/* Number of digits - 1: */
+	while (k && val < pgm_read_dword(&_cp_pow10[k])) {
+		--k;
+	}
+	top = k;
+	for (;; --k) {
+		p = pgm_read_dword(&_cp_pow10[k]);
+		for (d = '0'; val >= p; ++d) {
+			val -= p;
+		}
+		if (k < init_i) {
+			buf[init_i - k] = d;
+		}
+		if (k == 0) {
+			break;
+		}
+	}
+
+	return (top < init_i) ? init_i - top - 1 : 0;
+}
+
 uint16_t cp_strlen(const char* str) {
 	uint16_t i = '\0';
 
@@ -77,6 +145,31 @@ char* cp_itoa(char* buf, uint8_t buf_len, int16_t val, uint8_t base) {
 	return &buf[i + 1];
 }
 
+char* cp_ultoa(char* buf, uint8_t buf_len, uint32_t val, uint8_t base) {
+	uint8_t i = buf_len - 2;
+	
+	buf[buf_len - 1] = '\0';
+	i = _cp_abs_lntoa(buf, val, base, i);
+	
+	return &buf[i + 1];
+}
+
+char* cp_ltoa(char* buf, uint8_t buf_len, int32_t val, uint8_t base) {
+	uint8_t i = buf_len - 2;
+	uint8_t is_neg = (val < 0);
+	uint32_t abs_val;
+	
+	buf[buf_len - 1] = '\0';
+	abs_val = is_neg ? 0UL - (uint32_t) val : (uint32_t) val;
+	i = _cp_abs_lntoa(buf, abs_val, base, i);
+	if (is_neg) {
+		buf[i] = '-';
+		--i;
+	}
+
+	return &buf[i + 1];
+}
+
 void cp_wait_ms(uint16_t ms) {
 	while (ms--) {
 		_delay_ms(1.0);
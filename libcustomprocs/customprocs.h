@@ -57,6 +57,28 @@ char* cp_utoa(char* buf, uint8_t buf_len, uint16_t val, uint8_t base);
  */
 char* cp_itoa(char* buf, uint8_t buf_len, int16_t val, uint8_t base);
 
+/**
+ * Unsigned long integer to ASCIIZ string.
+ *
+ * @param buf		Buffer to be used
+ * @param buf_len	Buffer length (be sure it's long enough)
+ * @param val		Unsigned long integer value
+ * @param base		Base (between 2 and 16)
+ * @return		ASCIIZ string (pointing inside given buffer)
+ */
+char* cp_ultoa(char* buf, uint8_t buf_len, uint32_t val, uint8_t base);
+
+/**
+ * Signed long integer to ASCIIZ string.
+ *
+ * @param buf		Buffer to be used
+ * @param buf_len	Buffer length (be sure it's long enough)
+ * @param val		Signed long integer value
+ * @param base		Base (between 2 and 16)
+ * @return		ASCIIZ string (pointing inside given buffer)
+ */
+char* cp_ltoa(char* buf, uint8_t buf_len, int32_t val, uint8_t base);
+
 /**
  * Waits a variable number of milliseconds.
  *
@@ -0,0 +1,42 @@
+/*
+ * Checks of the host tests.
+ *
+ * CHECK reports a condition that does not hold, with its file and line,
+ * and the test goes on.  CheckReport ends a test with its result.
+ */
+#ifndef _TEST_CHECK_H
+#define _TEST_CHECK_H
+
+#include <stdio.h>
+
+static unsigned failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+/**
+ * @brief Reports the result of a test
+ *
+ * @param name Name of the test
+ * @return Exit status of the test, 0 if every check held
+ */
+static inline int CheckReport(const char *name)
+{
+    if (failures)
+    {
+        printf("%s: %u failure(s)\n", name, failures);
+        return 1;
+    }
+
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif /* _TEST_CHECK_H */
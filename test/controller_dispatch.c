@@ -0,0 +1,204 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The dispatch table of the controller against a first match scan of its
+ * transitions.
+ *
+ * The controller is built into this test, so the static table and the
+ * TRANSITIONS rows can be read.  Every state and event must resolve to the
+ * row a scan in table order finds first, which is how Controller_Run used
+ * to take the transitions.
+ *
+ * The cost report counts the rows the scan passed over for each state and
+ * event, and turns them into cycles with estimates of the avr-gcc -Os code,
+ * made by hand from the instruction timings since there is no AVR
+ * toolchain or simulator here.  The scan loaded each 5 byte row from SRAM
+ * and compared its state, its event only for a row of the state, then
+ * copied the row it took.  The lookup is an index, a load from flash and
+ * the unpacking of the byte.  Around the dispatch, a run with no input
+ * event costs the same either way: the empty input queue, the handler
+ * call and the check of the published state.
+ */
+
+#include <stdio.h>
+
+#include "application/controller.c"
+
+#include "check.h"
+
+#define STATE_MISS_CYCLES   12  /* Row of another state, and the loop   */
+#define EVENT_MISS_CYCLES   16  /* Row of the state, for another event  */
+#define TAKE_CYCLES         36  /* Row taken, copied into the current   */
+#define SCAN_FIXED_CYCLES   17  /* Handler pointer compares, end check  */
+#define LOOKUP_CYCLES       28  /* Index, LPM, unpack, handler id checks */
+#define RUN_CYCLES          75  /* Queue check, call, return, Publish   */
+
+bool BSPInterface_GetInputEvent(bsp_input_event_t *event)
+{
+    return false;
+}
+
+bool Frame_GetInputState(uint8_t id)
+{
+    return false;
+}
+
+void Frame_GetTimestamp(bsp_timestamp_t *timestamp)
+{
+}
+
+void ScoreKeeper_Start(const bsp_timestamp_t *start)
+{
+}
+
+void ScoreKeeper_Penalty(void)
+{
+}
+
+void ScoreKeeper_End(const bsp_timestamp_t *end)
+{
+}
+
+bool (Timer_Initialize)(timer_t *timer, timer_modes_t mode, uint32_t period)
+{
+    return true;
+}
+
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context)
+{
+}
+
+bool (Timer_SetTimeoutPeriod)(timer_t *timer, uint32_t period)
+{
+    return true;
+}
+
+void Timer_Reset(timer_t *timer)
+{
+}
+
+bool Timer_Timeout(timer_t *timer)
+{
+    return false;
+}
+
+typedef struct
+{
+    state_t state;
+    event_t event;
+    handler_t handler;
+    state_t next;
+} row_t;
+
+#define ROW_OF(S, E, state, event, handler, next) \
+    { state, event, HANDLER_##handler, next },
+
+static const row_t rows[] =
+{
+    TRANSITIONS(ROW_OF, 0, 0)
+};
+
+static const char *const stateNames[] =
+{
+#define NAME(name, a) #name,
+    STATES(NAME, 0)
+};
+
+/**
+ * @brief Scans the rows for a state and event, as Controller_Run did
+ *
+ * @param state Current state
+ * @param event Event of its handler
+ * @param cycles Set to the estimated cycles of the scan
+ * @return The row taken, or NULL for none
+ */
+static const row_t *Scan(state_t state, event_t event, unsigned *cycles)
+{
+    uint8_t i;
+
+    *cycles = SCAN_FIXED_CYCLES;
+
+    for (i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+    {
+        if ((rows[i].state != state) && (ST_ANY != rows[i].state))
+        {
+            *cycles += STATE_MISS_CYCLES;
+        }
+        else if ((rows[i].event != event) && (EV_ANY != rows[i].event))
+        {
+            *cycles += EVENT_MISS_CYCLES;
+        }
+        else
+        {
+            *cycles += TAKE_CYCLES;
+            return &rows[i];
+        }
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    unsigned idle;
+    unsigned worst;
+    unsigned total = 0;
+    unsigned cycles;
+    uint8_t state;
+    uint8_t event;
+
+    printf("state            old idle  old worst  new  (cycles per Controller_Run)\n");
+
+    for (state = 0; state < ST_ANY; state++)
+    {
+        worst = 0;
+        idle = 0;
+
+        for (event = 0; event < EV_ANY; event++)
+        {
+            const row_t *row = Scan((state_t)state, (event_t)event, &cycles);
+            const uint8_t next = pgm_read_byte(&dispatch[state][event]);
+
+            CHECK(NULL != row);
+            if (NULL != row)
+            {
+                CHECK(DISPATCH_NEXT(next) == row->next);
+                CHECK(DISPATCH_HANDLER(next) == row->handler);
+            }
+
+            if (EV_NONE == event)
+            {
+                idle = cycles;
+            }
+            if (worst < cycles)
+            {
+                worst = cycles;
+            }
+        }
+
+        total += idle;
+        printf("%-16s %8u  %9u  %3u\n", stateNames[state],
+            RUN_CYCLES + idle, RUN_CYCLES + worst, RUN_CYCLES + LOOKUP_CYCLES);
+    }
+
+    printf("mean idle run: %u cycles before, %u after\n",
+        RUN_CYCLES + total / ST_ANY, RUN_CYCLES + LOOKUP_CYCLES);
+
+    return CheckReport("controller_dispatch");
+}
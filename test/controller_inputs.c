@@ -0,0 +1,177 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The controller against input events queued faster than it runs.
+ *
+ * The frame holds the input levels as of the last event queued, so when
+ * several events are handled in one run, it is already ahead of those
+ * still to be handled.
+ */
+
+#include <stdio.h>
+
+#include "application/controller.h"
+#include "bsp/bsp.h"
+#include "common/bsp_interface.h"
+#include "common/frame.h"
+#include "common/timers.h"
+#include "application/score_keeper.h"
+
+#include "check.h"
+
+#define QUEUE_SIZE 4
+
+static bsp_input_event_t queue[QUEUE_SIZE];
+static uint8_t queued;
+static uint8_t handled;
+
+static bool frameLevel[BSP_NUMBER_OF_INPUTS];
+static uint32_t now;
+static bool expired;
+
+static unsigned penalties;
+static bool ended;
+static bsp_timestamp_t endTime;
+
+bool BSPInterface_GetInputEvent(bsp_input_event_t *event)
+{
+    if (handled == queued)
+    {
+        return false;
+    }
+
+    *event = queue[handled++];
+
+    return true;
+}
+
+bool Frame_GetInputState(uint8_t id)
+{
+    return frameLevel[id];
+}
+
+void Frame_GetTimestamp(bsp_timestamp_t *timestamp)
+{
+    timestamp->ticks = now;
+    timestamp->us = 0;
+}
+
+void ScoreKeeper_Start(const bsp_timestamp_t *start)
+{
+}
+
+void ScoreKeeper_Penalty(void)
+{
+    penalties++;
+}
+
+void ScoreKeeper_End(const bsp_timestamp_t *end)
+{
+    ended = true;
+    endTime = *end;
+}
+
+bool (Timer_Initialize)(timer_t *timer, timer_modes_t mode, uint32_t period)
+{
+    return true;
+}
+
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context)
+{
+}
+
+bool (Timer_SetTimeoutPeriod)(timer_t *timer, uint32_t period)
+{
+    return true;
+}
+
+void Timer_Reset(timer_t *timer)
+{
+}
+
+bool Timer_Timeout(timer_t *timer)
+{
+    return expired;
+}
+
+/**
+ * @brief Queues an input event, and the frame follows it at once
+ *
+ * @param id The input
+ * @param state Level it changed to
+ * @param ticks Time of the change
+ */
+static void Queue(uint8_t id, bool state, uint32_t ticks)
+{
+    queue[queued].id = id;
+    queue[queued].state = state;
+    queue[queued].timestamp.ticks = ticks;
+    queue[queued].timestamp.us = 0;
+    queued++;
+
+    frameLevel[id] = state;
+}
+
+/**
+ * @brief Starts a game, left from the left post at tick 200
+ */
+static void Play(void)
+{
+    Controller_Initialize();
+
+    /* Through the boot screen */
+    expired = true;
+    Controller_Run();
+    Controller_Run();
+    expired = false;
+    CHECK(STATE_WAITING == Controller_GetState());
+
+    Queue(BSP_INPUT_BUZZ_LEFT_POST, true, 100);
+    Controller_Run();
+    CHECK(STATE_BEGIN == Controller_GetState());
+
+    Queue(BSP_INPUT_BUZZ_LEFT_POST, false, 200);
+    Controller_Run();
+    CHECK(STATE_RUNNING == Controller_GetState());
+}
+
+/**
+ * @brief The wire touched before the right post is still a penalty
+ */
+static void TestWireThenRightPost(void)
+{
+    Play();
+
+    now = 999;
+    Queue(BSP_INPUT_BUZZ_WIRE, true, 300);
+    Queue(BSP_INPUT_BUZZ_RIGHT_POST, true, 400);
+    Controller_Run();
+
+    CHECK(1 == penalties);
+    CHECK(ended);
+    CHECK(400 == endTime.ticks);
+    CHECK(STATE_DONE == Controller_GetState());
+}
+
+int main(void)
+{
+    TestWireThenRightPost();
+
+    return CheckReport("controller_inputs");
+}
@@ -0,0 +1,160 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The integer to string conversions of customprocs against snprintf.
+ *
+ * Every 16-bit value is converted, and the 32-bit ones around each power
+ * of ten and at the ends of their range, where the digit loops turn.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libcustomprocs/customprocs.h"
+
+#include "check.h"
+
+void _delay_ms(double ms)
+{
+}
+
+/**
+ * @brief Checks a conversion, once and stops at the first mismatch
+ *
+ * @param got String converted
+ * @param expected String from snprintf
+ * @return 1 if they match
+ */
+static uint8_t Same(const char *got, const char *expected)
+{
+    if (strcmp(got, expected))
+    {
+        printf("got \"%s\", expected \"%s\"\n", got, expected);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Every 16-bit value, in base 10 and 16
+ */
+static void Test16(void)
+{
+    char buf[8];
+    char expected[8];
+    uint32_t v;
+
+    for (v = 0; v <= 0xFFFF; v++)
+    {
+        snprintf(expected, sizeof(expected), "%u", (unsigned)v);
+        if (!Same(cp_utoa(buf, sizeof(buf), (uint16_t)v, 10), expected))
+        {
+            CHECK(0);
+            break;
+        }
+
+        snprintf(expected, sizeof(expected), "%x", (unsigned)v);
+        if (!Same(cp_utoa(buf, sizeof(buf), (uint16_t)v, 16), expected))
+        {
+            CHECK(0);
+            break;
+        }
+
+        snprintf(expected, sizeof(expected), "%d", (int16_t)v);
+        if (!Same(cp_itoa(buf, sizeof(buf), (int16_t)v, 10), expected))
+        {
+            CHECK(0);
+            break;
+        }
+
+        snprintf(expected, sizeof(expected), "%lu", (unsigned long)v);
+        if (!Same(cp_ultoa(buf, sizeof(buf), v, 10), expected))
+        {
+            CHECK(0);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Checks a 32-bit value, unsigned and signed, in base 10 and 16
+ *
+ * @param v Value
+ */
+static void Check32(uint32_t v)
+{
+    char buf[16];
+    char expected[16];
+
+    snprintf(expected, sizeof(expected), "%lu", (unsigned long)v);
+    CHECK(Same(cp_ultoa(buf, sizeof(buf), v, 10), expected));
+
+    snprintf(expected, sizeof(expected), "%lx", (unsigned long)v);
+    CHECK(Same(cp_ultoa(buf, sizeof(buf), v, 16), expected));
+
+    snprintf(expected, sizeof(expected), "%ld", (long)(int32_t)v);
+    CHECK(Same(cp_ltoa(buf, sizeof(buf), (int32_t)v, 10), expected));
+}
+
+/**
+ * @brief 32-bit values around each power of ten and at the range ends
+ */
+static void Test32(void)
+{
+    uint32_t p = 1;
+    uint8_t k;
+    int8_t d;
+
+    for (k = 0; k < 10; k++, p *= 10)
+    {
+        for (d = -2; d <= 2; d++)
+        {
+            Check32(p + d);
+            Check32(0UL - (p + d));
+            Check32(9 * p + d);
+        }
+    }
+
+    Check32(0);
+    Check32(0x7FFFFFFFUL);
+    Check32(0x80000000UL);
+    Check32(0xFFFFFFFFUL);
+}
+
+/**
+ * @brief A buffer too short keeps the least significant digits, with its
+ *        first char left for a sign
+ */
+static void TestShortBuffer(void)
+{
+    char buf[4];
+
+    CHECK(Same(cp_ultoa(buf, sizeof(buf), 12345UL, 10), "45"));
+    CHECK(Same(cp_utoa(buf, sizeof(buf), 12345U, 10), "45"));
+}
+
+int main(void)
+{
+    Test16();
+    Test32();
+    TestShortBuffer();
+
+    return CheckReport("customprocs");
+}
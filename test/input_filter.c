@@ -0,0 +1,218 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The input filter of the BSP against traces of the contacts.
+ *
+ * A trace has a character per tick: '.' for no contact, '#' for a contact
+ * through the tick and '!' for a contact that starts and ends within it.
+ * Edges are made at 100 us into the tick on the input pin, with the
+ * external interrupt of the input raised as the hardware would: on a
+ * contact for the wire and the right post, on both edges for the left
+ * post.  The filter samples at the end of each tick, as the tick interrupt
+ * does.  Each trace comes with the changes it must report, and the tick
+ * each is timed at.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bsp/bsp.h"
+#include "bsp/timers.h"
+#include "common/bsp_interface.h"
+
+#include "check.h"
+
+/* Interrupt handlers of the inputs, in bsp/bsp.c */
+void INT0_vect(void);
+void INT1_vect(void);
+void INT2_vect(void);
+
+typedef struct
+{
+    bsp_inputs_t id;
+    const char *trace;
+    const char *changes;  /* "+" or "-" and the tick, for each change */
+} fixture_t;
+
+static const fixture_t fixtures[] =
+{
+    /* Bounce: a change is reported once, timed from the first edge the */
+    /* integrator does not lose.  The end of a contact on the wire or the */
+    /* right post has no interrupt, it is timed by the sample that first  */
+    /* misses it                                                          */
+    { BSP_INPUT_BUZZ_WIRE,
+      "....#.#.##.########.#.#......................",
+      "+4 -24" },
+    { BSP_INPUT_BUZZ_RIGHT_POST,
+      "...#..#.#####.#...............",
+      "+3 -16" },
+    { BSP_INPUT_BUZZ_LEFT_POST,
+      "..#.#.######.#.##.........................",
+      "+6 -17" },
+
+    /* Chatter: a contact that keeps breaking is held, not repeated */
+    { BSP_INPUT_BUZZ_WIRE,
+      "..#.#.#.#.#.#.#.#.#.#.#.#.#.#.#.#...........................",
+      "+2 -34" },
+    { BSP_INPUT_BUZZ_LEFT_POST,
+      "...#.#.#.#.#.#.#.#.#.........",
+      "" },
+
+    /* Glitch: a contact shorter than the tick still counts for the wire */
+    /* and the right post, the left post needs several ms                */
+    { BSP_INPUT_BUZZ_WIRE,
+      "...!..........................",
+      "+3 -5" },
+    { BSP_INPUT_BUZZ_RIGHT_POST,
+      "..!.......................",
+      "+2 -4" },
+    { BSP_INPUT_BUZZ_LEFT_POST,
+      "..!..!..###...........",
+      "" },
+
+    /* A break in a held contact does not end it */
+    { BSP_INPUT_BUZZ_WIRE,
+      "..##########.#########!########............................",
+      "+2 -32" },
+};
+
+static bsp_timestamp_t now;
+
+void BSP_InitializeTimers(void)
+{
+}
+
+void BSPInterface_GetTimestamp(bsp_timestamp_t *timestamp)
+{
+    *timestamp = now;
+}
+
+uint8_t hd44780fw_q_service(struct hd44780fw_conf *conf)
+{
+    return 0;
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    memset(dst, 0xFF, n);
+}
+
+/**
+ * @brief Sets the level of an input pin, raising its interrupt on the edges
+ *        the hardware would
+ *
+ * @param id The input
+ * @param contact true to close the contact
+ */
+static void SetInput(bsp_inputs_t id, bool contact)
+{
+    switch (id)
+    {
+    case BSP_INPUT_BUZZ_LEFT_POST:
+        if (contact != !(PINB & _BV(2)))
+        {
+            PINB = contact ? (PINB & ~_BV(2)) : (PINB | _BV(2));
+            INT2_vect();
+        }
+        break;
+    case BSP_INPUT_BUZZ_RIGHT_POST:
+        if (contact != !(PIND & _BV(3)))
+        {
+            PIND = contact ? (PIND & ~_BV(3)) : (PIND | _BV(3));
+            if (contact)
+            {
+                INT1_vect();
+            }
+        }
+        break;
+    default:
+        if (contact != !(PIND & _BV(2)))
+        {
+            PIND = contact ? (PIND & ~_BV(2)) : (PIND | _BV(2));
+            if (contact)
+            {
+                INT0_vect();
+            }
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Runs a trace through the filter and compares the changes
+ *
+ * @param fixture The trace and its changes
+ */
+static void Run(const fixture_t *fixture)
+{
+    char changes[64] = "";
+    bsp_input_event_t event;
+    uint8_t tick;
+
+    /* All contacts open */
+    PINB = 0xFF;
+    PIND = 0xFF;
+    BSPInterface_Initialize();
+
+    for (tick = 0; '\0' != fixture->trace[tick]; tick++)
+    {
+        const char level = fixture->trace[tick];
+
+        now.ticks = tick;
+        now.us = 100;
+        SetInput(fixture->id, '.' != level);
+
+        if ('!' == level)
+        {
+            now.us = 300;
+            SetInput(fixture->id, false);
+        }
+
+        now.ticks = tick + 1;
+        now.us = 0;
+        BSP_SampleInputs();
+    }
+
+    while (BSPInterface_GetInputEvent(&event))
+    {
+        CHECK(fixture->id == event.id);
+        snprintf(changes + strlen(changes), sizeof(changes) - strlen(changes),
+            "%s%c%lu", ('\0' == changes[0]) ? "" : " ",
+            event.state ? '+' : '-', (unsigned long)event.timestamp.ticks);
+    }
+
+    if (0 != strcmp(fixture->changes, changes))
+    {
+        printf("%s\n  expected \"%s\", reported \"%s\"\n",
+            fixture->trace, fixture->changes, changes);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < sizeof(fixtures) / sizeof(fixtures[0]); i++)
+    {
+        Run(&fixtures[i]);
+    }
+
+    return CheckReport("input_filter");
+}
@@ -0,0 +1,500 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Busy flag polling of the HD44780 low level driver, against a model of the
+ * device on fake ports.
+ *
+ * The model sees the bus whenever the driver waits: the driver raises EN
+ * right before each of its short delays, so a rising EN with R/W low latches
+ * an instruction or data byte, and a rising EN with R/W high is a read, for
+ * which DB7 is driven with the busy flag.  Time only passes in the delays,
+ * rounded up to whole CPU cycles as avr-libc does, plus the estimated cycles
+ * of the loop around each BF read and each 1 us step of the fixed wait.
+ *
+ * The per screen report runs application/display.c through the framework
+ * in synchronous mode, once waiting the worst-case execution times and
+ * once polling BF, and compares the time spent on the bus.  The queue check
+ * then drains a screen the way the Timer2 interrupt does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lib44780/hd44780_low.h"
+#include "lib44780fw/hd44780fw.h"
+#include "common/timers.h"
+#include "application/controller.h"
+#include "application/score_keeper.h"
+#include "application/display.h"
+#include "bsp/bsp.h"
+
+#include "check.h"
+
+#define CPU_MHZ (F_CPU / 1000000UL)
+
+/* Cycles of the code around the delays, counted on the static wiring code */
+/* (sbi/cbi on the pins): set EN, read PIN, clear EN and the loop test for */
+/* a BF read; the counter update and branch for a 1 us wait step           */
+#define READ_LOOP_CYCLES  12
+#define WAIT_LOOP_CYCLES  5
+
+/* Execution times of the device at its typical 270 kHz clock, in us */
+#define EXEC_US       37
+#define EXEC_DATA_US  (37 + 4)
+#define EXEC_LONG_US  1520
+
+/* Fake ports, laid out as on the AVR: PIN, DDR, then PORT */
+static volatile uint8_t dataPort[3];
+static volatile uint8_t controlPort[3];
+
+#define RS_I  4
+#define RW_I  5
+#define EN_I  6
+
+static struct
+{
+    uint32_t now;          /* Cycles since reset                       */
+    uint32_t readyAt;      /* Cycle the last instruction completes     */
+    uint8_t en;            /* EN level at the last delay               */
+    int16_t busyReads;     /* Reads to answer busy, < 0 to use timing  */
+    uint32_t reads;        /* BF reads                                 */
+    uint32_t bytes;        /* Instructions and data latched            */
+    uint32_t early;        /* Bytes latched while busy                 */
+    uint16_t crc;          /* Digest of the bytes latched              */
+} device;
+
+static uint8_t bf = HD44780_L_BF_POLL;
+
+/**
+ * @brief Lets the device react to the bus, then lets the time pass
+ *
+ * @param cycles CPU cycles that pass
+ */
+static void Device_Step(uint32_t cycles)
+{
+    const uint8_t en = controlPort[2] & _BV(EN_I);
+
+    if (en && !device.en)
+    {
+        if (controlPort[2] & _BV(RW_I))
+        {
+            bool busy;
+
+            if (0 <= device.busyReads)
+            {
+                busy = (0 < device.busyReads);
+                if (busy)
+                {
+                    device.busyReads--;
+                }
+            }
+            else
+            {
+                busy = ((int32_t)(device.now - device.readyAt) < 0);
+            }
+
+            dataPort[0] = busy ? _BV(7) : 0x00;
+            device.reads++;
+        }
+        else
+        {
+            const uint8_t rs = (0 != (controlPort[2] & _BV(RS_I)));
+            const uint8_t db = dataPort[2];
+            uint32_t exec = EXEC_US;
+
+            if ((int32_t)(device.now - device.readyAt) < 0)
+            {
+                device.early++;
+            }
+
+            if (rs)
+            {
+                exec = EXEC_DATA_US;
+            }
+            else if (db < 0x04)
+            {
+                exec = EXEC_LONG_US;
+            }
+
+            device.readyAt = device.now + exec * CPU_MHZ;
+            device.bytes++;
+            device.crc = (uint16_t)((device.crc << 5) + (device.crc >> 11)) ^ (rs << 8) ^ db;
+        }
+    }
+
+    device.en = en;
+    device.now += cycles;
+}
+
+void _delay_us(double us)
+{
+    uint32_t cycles = (uint32_t)(us * CPU_MHZ);
+
+    if (cycles < us * CPU_MHZ)
+    {
+        cycles++;
+    }
+
+    /* Only the fixed wait steps by a whole microsecond */
+    if (1.0 == us)
+    {
+        cycles += WAIT_LOOP_CYCLES;
+    }
+    /* And only a BF read waits for the data delay time */
+    else if (0.160 == us)
+    {
+        cycles += READ_LOOP_CYCLES;
+    }
+
+    Device_Step(cycles);
+}
+
+void _delay_ms(double ms)
+{
+    Device_Step((uint32_t)(ms * 1000.0 * CPU_MHZ));
+}
+
+/*
+ * Stand-ins for what display.c uses besides the display framework.
+ */
+
+static controller_listener_t listener;
+static timer_callback_t callbacks[3];
+static uint8_t callbackCount;
+static bcd_time_t runningTime;
+static struct hd44780fw_conf *queuedDisplay;
+static bool queued;
+
+void BSP_ConfigureDisplay(struct hd44780_l_conf *lcdfw)
+{
+    const struct hd44780_l_conf wiring =
+    {
+        .rs_i = RS_I, .rw_i = RW_I, .en_i = EN_I,
+        .db7_i = 7, .db6_i = 6, .db5_i = 5, .db4_i = 4,
+        .db3_i = 3, .db2_i = 2, .db1_i = 1, .db0_i = 0,
+        .rs_port = &controlPort[2], .rw_port = &controlPort[2],
+        .en_port = &controlPort[2],
+        .db7_port = &dataPort[2], .db6_port = &dataPort[2],
+        .db5_port = &dataPort[2], .db4_port = &dataPort[2],
+        .db3_port = &dataPort[2], .db2_port = &dataPort[2],
+        .db1_port = &dataPort[2], .db0_port = &dataPort[2],
+        .dl = HD44780_L_FS_DL_8BIT,
+    };
+
+    *lcdfw = wiring;
+    lcdfw->bf = bf;
+}
+
+static void StartQueue(void)
+{
+}
+
+void BSP_ConfigureDisplayQueue(struct hd44780fw_conf *fw)
+{
+    queuedDisplay = fw;
+    fw->q_start = queued ? StartQueue : NULL;
+}
+
+bool (Timer_Initialize)(timer_t *timer, timer_modes_t mode, uint32_t period)
+{
+    return true;
+}
+
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context)
+{
+    if (callbackCount < 3)
+    {
+        callbacks[callbackCount++] = callback;
+    }
+}
+
+void Timer_Reset(timer_t *timer)
+{
+}
+
+bool Controller_Subscribe(controller_listener_t l)
+{
+    listener = l;
+    return true;
+}
+
+const score_clock_t ScoreKeeper_GetClock(void)
+{
+    score_clock_t clock;
+
+    runningTime.tenths = (runningTime.tenths + 1) % 10;
+    clock.runningTime = runningTime;
+    clock.totalTime = runningTime;
+
+    return clock;
+}
+
+const score_t ScoreKeeper_GetLastScore(void)
+{
+    const score_t score = { 12300, 2, 22300, true };
+
+    return score;
+}
+
+const int8_t ScoreKeeper_GetRunningTimeRank(void) { return 3; }
+const int8_t ScoreKeeper_GetTotalTimeRank(void) { return 4; }
+const int8_t ScoreKeeper_GetPenaltyRank(void) { return -1; }
+
+/**
+ * @brief Sends one instruction and counts the BF reads it took
+ *
+ * @param busyReads Reads the device answers busy
+ * @param w_us Wait, or maximum number of reads
+ * @return Number of BF reads
+ */
+static uint32_t Send(struct hd44780_l_conf *conf, int16_t busyReads, uint16_t w_us)
+{
+    const uint32_t reads = device.reads;
+
+    device.busyReads = busyReads;
+    hd44780_l_send(conf, 0, HD44780_L_I_DDRAM(0x40), w_us);
+    device.busyReads = -1;
+
+    return device.reads - reads;
+}
+
+/**
+ * @brief Polling ends on the first ready read and never exceeds w_us reads
+ */
+static void TestPolling(void)
+{
+    struct hd44780_l_conf conf;
+    uint32_t start;
+
+    BSP_ConfigureDisplay(&conf);
+    conf.bf = HD44780_L_BF_POLL;
+    dataPort[1] = 0xFF;
+
+    CHECK(1 == Send(&conf, 0, HD44780_L_T_SHORT_US));
+    CHECK(2 == Send(&conf, 1, HD44780_L_T_SHORT_US));
+    CHECK(6 == Send(&conf, 5, HD44780_L_T_SHORT_US));
+    CHECK(HD44780_L_T_SHORT_US == Send(&conf, HD44780_L_T_SHORT_US - 1, HD44780_L_T_SHORT_US));
+    CHECK(HD44780_L_T_SHORT_US == Send(&conf, 1000, HD44780_L_T_SHORT_US));
+    CHECK(HD44780_L_T_LONG_US == Send(&conf, 30000, HD44780_L_T_LONG_US));
+    CHECK(0 == Send(&conf, 1000, 0));
+
+    /* The bus is given back to the MCU */
+    CHECK(0xFF == dataPort[1]);
+    CHECK(0 == (controlPort[2] & _BV(RW_I)));
+
+    /* Against the timing model, just enough reads to see it ready */
+    device.now += 10000;
+    Send(&conf, -1, 0);
+    start = device.now;
+    Send(&conf, -1, HD44780_L_T_SHORT_US);
+    CHECK(device.now - start >= EXEC_US * CPU_MHZ);
+    CHECK(device.now - start < EXEC_US * CPU_MHZ + 2 * (READ_LOOP_CYCLES + 2));
+
+    /* Waiting instead polls nothing */
+    conf.bf = HD44780_L_BF_WAIT;
+    CHECK(0 == Send(&conf, 1000, HD44780_L_T_SHORT_US));
+}
+
+typedef struct
+{
+    const char *name;
+    uint32_t bytes;
+    uint32_t cycles;
+    uint16_t crc;
+} screen_t;
+
+enum
+{
+    QUICK = 0,
+    MEDIUM,
+    SLOW
+};
+
+/**
+ * @brief Draws every screen of display.c, as the flush that shows it
+ *
+ * @param screens Bus time of each screen
+ * @return Number of screens
+ */
+static uint8_t DrawScreens(screen_t *screens)
+{
+    static const struct
+    {
+        const char *name;
+        int8_t state;
+        int8_t timer;
+    } steps[] =
+    {
+        { "initialize",      STATE_INITIALIZE, -1     },
+        { "waiting",         STATE_WAITING,    -1     },
+        { "waiting arrows",  -1,               QUICK  },
+        { "marquee step",    -1,               MEDIUM },
+        { "begin",           STATE_BEGIN,      -1     },
+        { "begin arrows",    -1,               QUICK  },
+        { "running",         STATE_RUNNING,    -1     },
+        { "running clock",   -1,               QUICK  },
+        { "buzz",            STATE_BUZZ,       -1     },
+        { "running again",   STATE_RUNNING,    -1     },
+        { "done",            STATE_DONE,       -1     },
+        { "done ranks",      -1,               SLOW   },
+    };
+    uint8_t i;
+
+    memset(&device, 0, sizeof(device));
+    device.busyReads = -1;
+    callbackCount = 0;
+    BcdTime_Reset(&runningTime);
+
+    Display_Initialize();
+
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+    {
+        const uint32_t start = device.now;
+        const uint32_t bytes = device.bytes;
+
+        device.crc = 0;
+
+        if (0 <= steps[i].state)
+        {
+            listener((controller_state_t)steps[i].state);
+        }
+        else
+        {
+            callbacks[steps[i].timer](NULL);
+        }
+        Display_Run();
+
+        screens[i].name = steps[i].name;
+        screens[i].bytes = device.bytes - bytes;
+        screens[i].cycles = device.now - start;
+        screens[i].crc = device.crc;
+    }
+
+    return i;
+}
+
+/**
+ * @brief Compares the bus time of each screen, waiting and polling
+ */
+static void TestScreens(void)
+{
+    screen_t waited[16];
+    screen_t polled[16];
+    uint32_t total = 0;
+    uint8_t count;
+    uint8_t i;
+
+    bf = HD44780_L_BF_WAIT;
+    count = DrawScreens(waited);
+    CHECK(0 == device.early);
+
+    bf = HD44780_L_BF_POLL;
+    CHECK(count == DrawScreens(polled));
+    CHECK(0 == device.early);
+
+    printf("%-16s %6s %10s %10s %10s\n", "screen", "bytes", "wait us", "poll us", "saved us");
+
+    for (i = 0; i < count; i++)
+    {
+        const uint32_t wait = waited[i].cycles / CPU_MHZ;
+        const uint32_t poll = polled[i].cycles / CPU_MHZ;
+
+        /* The same bytes, only sooner */
+        CHECK(waited[i].bytes == polled[i].bytes);
+        CHECK(waited[i].crc == polled[i].crc);
+        CHECK(poll <= wait);
+
+        printf("%-16s %6lu %10lu %10lu %10lu\n", waited[i].name,
+            (unsigned long)waited[i].bytes, (unsigned long)wait,
+            (unsigned long)poll, (unsigned long)(wait - poll));
+        total += wait - poll;
+    }
+
+    printf("%-16s %6s %10s %10s %10lu\n", "total", "", "", "", (unsigned long)total);
+}
+
+/**
+ * @brief Drains the queue of a screen as the timer interrupt does
+ *
+ * Every service sends at most HD44780FW_Q_BURST bytes, none of them to a
+ * busy device, and keeps the bus for well under its period
+ */
+static void TestQueue(void)
+{
+    const uint32_t period = HD44780FW_Q_TICK_US * CPU_MHZ;
+    uint32_t services = 0;
+    uint32_t longest = 0;
+    uint32_t bytes;
+    uint32_t sent;
+
+    memset(&device, 0, sizeof(device));
+    device.busyReads = -1;
+    callbackCount = 0;
+    bf = HD44780_L_BF_POLL;
+    queued = true;
+
+    Display_Initialize();
+    listener(STATE_WAITING);
+    Display_Run();
+
+    bytes = (queuedDisplay->q_head - queuedDisplay->q_tail) & (HD44780FW_Q_SIZE - 1);
+    sent = device.bytes;
+
+    for (;;)
+    {
+        const uint32_t start = device.now;
+        const uint32_t before = device.bytes;
+
+        if (!hd44780fw_q_service(queuedDisplay))
+        {
+            break;
+        }
+
+        CHECK(device.bytes - before <= HD44780FW_Q_BURST);
+
+        if (longest < device.now - start)
+        {
+            longest = device.now - start;
+        }
+
+        CHECK(device.now - start < period / 2);
+        device.now = start + period;
+        services++;
+    }
+
+    queued = false;
+    sent = device.bytes - sent;
+
+    CHECK(0 < bytes);
+    CHECK(bytes == sent);
+    CHECK(0 == device.early);
+
+    printf("queue: %lu bytes in %lu services of %u us, longest %lu us on the bus\n",
+        (unsigned long)sent, (unsigned long)services, HD44780FW_Q_TICK_US,
+        (unsigned long)(longest / CPU_MHZ));
+}
+
+int main(void)
+{
+    TestPolling();
+    TestScreens();
+    TestQueue();
+
+    return CheckReport("lcd_busy_flag");
+}
@@ -0,0 +1,410 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The HD44780 framework against a model of the device memory.
+ *
+ * The low level driver is replaced by a model of DDRAM, CGRAM, the address
+ * counter and the display shift, so that the tests can check what is
+ * actually shown and how many bytes it took.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lib44780fw/hd44780fw.h"
+
+#include "check.h"
+
+static struct
+{
+    uint8_t ddram[2][HD44780FW_LINE_CELLS];
+    uint8_t cgram[HD44780FW_CC_COUNT * 8];
+    uint8_t ac;            /* Address counter              */
+    uint8_t cg;            /* Address counter is in CGRAM  */
+    uint8_t shift;         /* Display shift to the left    */
+    uint32_t bytes;        /* Instructions and data sent   */
+} lcd;
+
+static struct hd44780_l_conf low_conf;
+static struct hd44780fw_conf fw_conf;
+
+void _delay_us(double us)
+{
+}
+
+void _delay_ms(double ms)
+{
+}
+
+void hd44780_l_init(const struct hd44780_l_conf* conf, uint8_t n, uint8_t f,
+    uint8_t id, uint8_t s)
+{
+    memset(&lcd, 0, sizeof(lcd));
+    memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+}
+
+void hd44780_l_send(const struct hd44780_l_conf* conf, uint8_t rs, uint8_t db,
+    uint16_t w_us)
+{
+    lcd.bytes++;
+
+    if (rs && lcd.cg)
+    {
+        lcd.cgram[lcd.ac] = db;
+        lcd.ac = (lcd.ac + 1) % sizeof(lcd.cgram);
+    }
+    else if (rs)
+    {
+        const uint8_t line = (0x40 <= lcd.ac);
+        const uint8_t col = lcd.ac & 0x3F;
+
+        lcd.ddram[line][col] = db;
+        lcd.ac = (col + 1 < HD44780FW_LINE_CELLS) ? lcd.ac + 1 : (line ? 0x00 : 0x40);
+    }
+    else if (db & 0x80)
+    {
+        lcd.cg = 0;
+        lcd.ac = db & 0x7F;
+    }
+    else if (db & 0x40)
+    {
+        lcd.cg = 1;
+        lcd.ac = db & 0x3F;
+    }
+    else if (0x18 == (db & 0x1C))
+    {
+        lcd.shift = (lcd.shift + 1) % HD44780FW_LINE_CELLS;
+    }
+    else if (0x1C == (db & 0x1C))
+    {
+        lcd.shift = (lcd.shift + HD44780FW_LINE_CELLS - 1) % HD44780FW_LINE_CELLS;
+    }
+}
+
+/**
+ * @brief Gets a character shown on the device
+ *
+ * @param index Position on the display
+ * @return Character code
+ */
+static uint8_t Shown(uint8_t index)
+{
+    const uint8_t line = (16 <= index);
+    const uint8_t col = index % 16;
+
+    return lcd.ddram[line][(col + lcd.shift) % HD44780FW_LINE_CELLS];
+}
+
+static void Setup(void)
+{
+    memset(&low_conf, 0, sizeof(low_conf));
+    memset(&fw_conf, 0, sizeof(fw_conf));
+
+    low_conf.line1_base_addr = 0x00;
+    low_conf.line2_base_addr = 0x40;
+
+    fw_conf.low_conf = &low_conf;
+    fw_conf.total_chars = 32;
+    fw_conf.font = HD44780_L_FS_F_58;
+    fw_conf.lines = HD44780_L_FS_N_DUAL;
+
+    hd44780fw_init(&fw_conf);
+}
+
+/**
+ * @brief Makes distinct glyph rows
+ *
+ * @param rows Rows of the glyph
+ * @param n Glyph number
+ */
+static void Glyph(uint8_t *rows, uint8_t n)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+    {
+        rows[i] = (uint8_t)(n + i);
+    }
+}
+
+/**
+ * @brief A glyph is only built over one that is not displayed
+ */
+static void TestGlyphEviction(void)
+{
+    uint8_t rows[8];
+    uint8_t slots[8];
+    uint8_t cgram[sizeof(lcd.cgram)];
+    char c;
+    uint8_t i;
+
+    Setup();
+
+    for (i = 0; i < 8; i++)
+    {
+        Glyph(rows, i * 16);
+        slots[i] = hd44780fw_get_cc(&fw_conf, rows);
+        c = (char)slots[i];
+        hd44780fw_write_len(&fw_conf, &c, 1, i, HD44780FW_WR_NO_CLEAR_BEFORE);
+    }
+    hd44780fw_flush(&fw_conf);
+
+    /* The most recently used glyph is the only one off the display */
+    hd44780fw_write(&fw_conf, " ", 7, HD44780FW_WR_NO_CLEAR_BEFORE);
+    hd44780fw_flush(&fw_conf);
+    memcpy(cgram, lcd.cgram, sizeof(cgram));
+
+    Glyph(rows, 200);
+    CHECK(slots[7] == hd44780fw_get_cc(&fw_conf, rows));
+    CHECK(0 == memcmp(cgram, lcd.cgram, slots[7] * 8));
+    CHECK(0 == memcmp(rows, &lcd.cgram[slots[7] * 8], 8));
+
+    /* With all of them displayed, none is replaced */
+    c = (char)slots[7];
+    hd44780fw_write_len(&fw_conf, &c, 1, 7, HD44780FW_WR_NO_CLEAR_BEFORE);
+    hd44780fw_flush(&fw_conf);
+    memcpy(cgram, lcd.cgram, sizeof(cgram));
+
+    Glyph(rows, 220);
+    CHECK(HD44780FW_CC_NONE == hd44780fw_get_cc(&fw_conf, rows));
+    CHECK(0 == memcmp(cgram, lcd.cgram, sizeof(cgram)));
+
+    for (i = 0; i < 8; i++)
+    {
+        CHECK(slots[i] == Shown(i));
+    }
+}
+
+/**
+ * @brief Checks that a line shows a marquee text
+ *
+ * @param line Line of the marquee
+ * @param text Marquee text
+ * @param len Length of the text
+ * @param pos Text index at the left edge
+ * @return 1 if the line shows the text
+ */
+static uint8_t ShowsMarquee(uint8_t line, const char *text, uint8_t len, uint8_t pos)
+{
+    uint8_t i;
+
+    for (i = 0; i < 16; i++)
+    {
+        if (Shown(line * 16 + i) != (uint8_t)text[(pos + i) % len])
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Checks that a line shows a text
+ *
+ * @param line Line to check
+ * @param text 16 characters
+ * @return 1 if the line shows the text
+ */
+static uint8_t ShowsLine(uint8_t line, const char *text)
+{
+    return ShowsMarquee(line, text, 16, 0);
+}
+
+/**
+ * @brief Scrolls a text under another line
+ *
+ * @param other Text of the other line, 16 characters
+ * @param text Marquee text
+ * @param len Length of the text
+ * @param most Most bytes a step may take
+ * @return Bytes of the costliest step
+ */
+static uint32_t Scroll(const char *other, const char *text, uint8_t len, uint32_t most)
+{
+    uint32_t costliest = 0;
+    uint8_t step;
+
+    Setup();
+
+    hd44780fw_write_len(&fw_conf, other, 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
+    hd44780fw_marquee(&fw_conf, text, len, 1);
+    hd44780fw_flush(&fw_conf);
+
+    for (step = 1; step <= 2 * HD44780FW_LINE_CELLS + 3; step++)
+    {
+        const uint32_t bytes = lcd.bytes;
+
+        hd44780fw_marquee_step(&fw_conf);
+        hd44780fw_flush(&fw_conf);
+
+        if (costliest < lcd.bytes - bytes)
+        {
+            costliest = lcd.bytes - bytes;
+        }
+
+        CHECK(ShowsLine(0, other));
+        CHECK(ShowsMarquee(1, text, len, step % len));
+    }
+
+    CHECK(costliest <= most);
+
+    return costliest;
+}
+
+/**
+ * @brief A step is one shift under a blank line, the other line stays put
+ */
+static void TestMarquee(void)
+{
+    static const char blank[] = "                ";
+    static const char arrows[] = "---\x01---\x01---\x01---\x01";
+    static const char text20[] = "Touch ring to win.. ";
+    static const char text23[] = "Touch ring to start... ";
+
+    CHECK(1 == Scroll(blank, text20, 20, 1));
+    CHECK(3 == Scroll(blank, text23, 23, 3));
+    Scroll(arrows, text23, 23, 3 + 16 + 2);
+}
+
+/**
+ * @brief Chars left off screen by the marquee do not keep a glyph in use
+ */
+static void TestMarqueeGlyphs(void)
+{
+    uint8_t rows[8];
+    uint8_t slots[8];
+    char text[20];
+    char other[16];
+    uint8_t i;
+
+    Setup();
+
+    for (i = 0; i < 8; i++)
+    {
+        Glyph(rows, i * 16);
+        slots[i] = hd44780fw_get_cc(&fw_conf, rows);
+    }
+
+    /* Seven glyphs in the text, the last one all over the other line */
+    for (i = 0; i < sizeof(text); i++)
+    {
+        text[i] = (i < 7) ? (char)slots[i] : ' ';
+    }
+    memset(other, (char)slots[7], sizeof(other));
+
+    hd44780fw_write_len(&fw_conf, other, 16, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
+    hd44780fw_marquee(&fw_conf, text, sizeof(text), 1);
+    hd44780fw_flush(&fw_conf);
+
+    for (i = 0; i < 5; i++)
+    {
+        hd44780fw_marquee_step(&fw_conf);
+        hd44780fw_flush(&fw_conf);
+    }
+
+    /* Once the other line is blank, the last glyph is only off screen */
+    hd44780fw_write(&fw_conf, "                ", 0, HD44780FW_WR_NO_CLEAR_BEFORE);
+    hd44780fw_flush(&fw_conf);
+
+    Glyph(rows, 200);
+    CHECK(slots[7] == hd44780fw_get_cc(&fw_conf, rows));
+
+    /* The text ones can all scroll back into view, so only it is reused */
+    Glyph(rows, 220);
+    CHECK(slots[7] == hd44780fw_get_cc(&fw_conf, rows));
+}
+
+/**
+ * @brief A flush sends what was written since the last one, a clear too
+ */
+static void TestFlushWritten(void)
+{
+    static const char blank[] = "                ";
+    static const char text[] = "0123456789abcdef";
+    uint32_t bytes;
+
+    Setup();
+
+    hd44780fw_write(&fw_conf, text, 0, HD44780FW_WR_NO_CLEAR_BEFORE);
+    hd44780fw_flush(&fw_conf);
+    CHECK(ShowsLine(0, text));
+
+    bytes = lcd.bytes;
+    CHECK(0 == hd44780fw_flush(&fw_conf));
+    CHECK(bytes == lcd.bytes);
+
+    hd44780fw_clear(&fw_conf);
+    hd44780fw_flush(&fw_conf);
+    CHECK(ShowsLine(0, blank));
+}
+
+static void StartQueue(void)
+{
+}
+
+/**
+ * @brief A flush never waits on a full queue, it leaves the rest for later
+ */
+static void TestQueueFull(void)
+{
+    char text[32];
+    uint32_t bytes;
+    uint8_t round;
+    uint8_t i;
+
+    Setup();
+    fw_conf.q_start = StartQueue;
+    bytes = lcd.bytes;
+
+    /* Nothing services the queue, so it fills up after a few rounds */
+    for (round = 0; round < 8; round++)
+    {
+        for (i = 0; i < sizeof(text); i++)
+        {
+            text[i] = (char)('A' + (round + i) % 26);
+        }
+        hd44780fw_write_len(&fw_conf, text, sizeof(text), 0, HD44780FW_WR_NO_CLEAR_BEFORE);
+        hd44780fw_flush(&fw_conf);
+    }
+    CHECK(bytes == lcd.bytes);
+
+    while (hd44780fw_q_service(&fw_conf))
+    {
+    }
+    CHECK(!ShowsLine(1, text + 16));
+
+    hd44780fw_flush(&fw_conf);
+    while (hd44780fw_q_service(&fw_conf))
+    {
+    }
+    CHECK(ShowsLine(0, text));
+    CHECK(ShowsLine(1, text + 16));
+}
+
+int main(void)
+{
+    TestGlyphEviction();
+    TestMarquee();
+    TestMarqueeGlyphs();
+    TestFlushWritten();
+    TestQueueFull();
+
+    return CheckReport("lcd_framework");
+}
@@ -0,0 +1,219 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The leaderboard of the score keeper over power cycles.
+ *
+ * The storage is an EEPROM in RAM, that keeps its content when the score
+ * keeper is initialized again as at boot.  The CRC of the copies is the
+ * avr-libc one, from the stand-in for <util/crc16.h>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "application/score_keeper.h"
+#include "common/bsp_interface.h"
+#include "common/frame.h"
+#include "common/timers.h"
+
+#include "check.h"
+
+/* Size of a leaderboard copy, as score_keeper.c lays it out */
+#define COPY_SIZE   (3 * 10 * 4 + 4)
+#define SLOTS       16
+
+static uint8_t eeprom[4096];
+static bool busy;
+static uint32_t writes;
+static uint16_t lastAddress;
+
+static bsp_timestamp_t now;
+static timer_callback_t saveRetry;
+
+void Frame_GetTimestamp(bsp_timestamp_t *timestamp)
+{
+    *timestamp = now;
+}
+
+void BSPInterface_ReadStorage(uint16_t address, void *data, uint16_t length)
+{
+    memcpy(data, &eeprom[address], length);
+}
+
+bool BSPInterface_WriteStorage(uint16_t address, const void *data, uint16_t length)
+{
+    if (busy)
+    {
+        return false;
+    }
+
+    memcpy(&eeprom[address], data, length);
+    writes++;
+    lastAddress = address;
+
+    return true;
+}
+
+bool BSPInterface_StorageBusy(void)
+{
+    return busy;
+}
+
+bool (Timer_Initialize)(timer_t *timer, timer_modes_t mode, uint32_t period)
+{
+    return true;
+}
+
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context)
+{
+    saveRetry = callback;
+}
+
+void Timer_Reset(timer_t *timer)
+{
+}
+
+/**
+ * @brief Erases the EEPROM and boots
+ */
+static void Erase(void)
+{
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    writes = 0;
+    ScoreKeeper_Initialize();
+}
+
+/**
+ * @brief Plays a game
+ *
+ * @param ms Running time, in whole tenths
+ * @param penalties Number of penalties
+ */
+static void Play(uint32_t ms, uint8_t penalties)
+{
+    ScoreKeeper_Start(&now);
+
+    while (penalties--)
+    {
+        ScoreKeeper_Penalty();
+    }
+
+    now.ticks += ms;
+    ScoreKeeper_End(&now);
+    now.ticks += 60000;
+}
+
+/**
+ * @brief Both record lists are back after a power cycle
+ */
+static void TestPowerCycle(void)
+{
+    Erase();
+
+    Play(5000, 2);
+    Play(7000, 1);
+    CHECK(2 == writes);
+
+    ScoreKeeper_Initialize();
+
+    Play(6000, 3);
+    CHECK(2 == ScoreKeeper_GetRunningTimeRank());
+    CHECK(3 == ScoreKeeper_GetPenaltyRank());
+}
+
+/**
+ * @brief A torn save falls back on the copy before it, and the next save
+ *        goes over it
+ */
+static void TestTornSave(void)
+{
+    Erase();
+
+    Play(5000, 0);
+    Play(4000, 0);
+    CHECK(COPY_SIZE == lastAddress);
+
+    /* Cut off after the sequence, the records are half written */
+    eeprom[COPY_SIZE] ^= 0x01;
+
+    ScoreKeeper_Initialize();
+
+    Play(4500, 0);
+    CHECK(1 == ScoreKeeper_GetRunningTimeRank());
+    CHECK(COPY_SIZE == lastAddress);
+}
+
+/**
+ * @brief The saves go round the slots, and the newest copy is loaded
+ */
+static void TestRotation(void)
+{
+    uint32_t slots = 0;
+    uint8_t i;
+
+    Erase();
+
+    /* Each game beats the last one, so each is saved */
+    for (i = 0; i < SLOTS + 4; i++)
+    {
+        Play(30000 - i * 100, 0);
+        slots |= 1UL << (lastAddress / COPY_SIZE);
+    }
+    CHECK(SLOTS + 4 == writes);
+    CHECK(0xFFFFUL == slots);
+    CHECK(3 * COPY_SIZE == lastAddress);
+
+    ScoreKeeper_Initialize();
+
+    /* The tenth best of the last save */
+    Play(30000 - (SLOTS + 4 - 10) * 100, 0);
+    CHECK(10 == ScoreKeeper_GetRunningTimeRank());
+}
+
+/**
+ * @brief A save while the last one is still being written is retried
+ */
+static void TestBusy(void)
+{
+    Erase();
+
+    busy = true;
+    Play(5000, 0);
+    CHECK(0 == writes);
+
+    busy = false;
+    saveRetry(NULL);
+    CHECK(1 == writes);
+
+    ScoreKeeper_Initialize();
+
+    Play(5000, 0);
+    CHECK(1 == ScoreKeeper_GetRunningTimeRank());
+    CHECK(1 == writes);
+}
+
+int main(void)
+{
+    TestPowerCycle();
+    TestTornSave();
+    TestRotation();
+    TestBusy();
+
+    return CheckReport("leaderboard");
+}
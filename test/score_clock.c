@@ -0,0 +1,228 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The BCD game clock of the score keeper.
+ *
+ * The frame time is set by the test, the storage is always idle and empty,
+ * and the timers do nothing, so ScoreKeeper_GetClock can be read at any
+ * time and compared with the millisecond counts.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "application/score_keeper.h"
+#include "common/bcd_time.h"
+#include "common/bsp_interface.h"
+#include "common/frame.h"
+#include "common/timers.h"
+
+#include "check.h"
+
+static bsp_timestamp_t now;
+
+void Frame_GetTimestamp(bsp_timestamp_t *timestamp)
+{
+    *timestamp = now;
+}
+
+void BSPInterface_ReadStorage(uint16_t address, void *data, uint16_t length)
+{
+    memset(data, 0xFF, length);
+}
+
+bool BSPInterface_WriteStorage(uint16_t address, const void *data, uint16_t length)
+{
+    return true;
+}
+
+bool BSPInterface_StorageBusy(void)
+{
+    return false;
+}
+
+bool (Timer_Initialize)(timer_t *timer, timer_modes_t mode, uint32_t period)
+{
+    return true;
+}
+
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context)
+{
+}
+
+void Timer_Reset(timer_t *timer)
+{
+}
+
+/**
+ * @brief Checks that a counter holds a time, down to the tenth
+ *
+ * @param time Counter
+ * @param ms Time it should hold
+ * @return 1 if it does
+ */
+static uint8_t Holds(const bcd_time_t *time, uint32_t ms)
+{
+    uint32_t minutes = ms / 60000UL;
+    uint8_t seconds = (ms / 1000) % 60;
+    uint8_t tenths = (ms / 100) % 10;
+
+    if (999 < minutes)
+    {
+        minutes = 999;
+        seconds = 59;
+        tenths = 9;
+    }
+
+    return (time->tenths == tenths) &&
+        (time->seconds == (((seconds / 10) << 4) | (seconds % 10))) &&
+        (time->minutes == (((minutes / 100) << 8) | (((minutes / 10) % 10) << 4) | (minutes % 10)));
+}
+
+/**
+ * @brief Time added in any amount carries like the millisecond count
+ */
+static void TestAdd(void)
+{
+    static const uint32_t steps[] = { 0, 1, 99, 100, 101, 550, 999, 1000, 1001, 59999,
+        60000, 60001, 3599999, 59999999, 60000000 };
+    bcd_time_t time;
+    uint32_t total;
+    uint8_t i;
+    uint8_t j;
+
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+    {
+        BcdTime_Reset(&time);
+        total = 0;
+
+        /* From a counter with every field part way */
+        BcdTime_Add(&time, 754321);
+        total += 754321;
+        CHECK(Holds(&time, total));
+
+        for (j = 0; j < 3; j++)
+        {
+            BcdTime_Add(&time, steps[i]);
+            total += steps[i];
+            CHECK(Holds(&time, total));
+        }
+    }
+
+    /* A millisecond at a time */
+    BcdTime_Reset(&time);
+    for (total = 1; total <= 130000; total++)
+    {
+        BcdTime_Add(&time, 1);
+        if (!Holds(&time, total))
+        {
+            CHECK(Holds(&time, total));
+            break;
+        }
+    }
+
+    /* Saturates, however much is added */
+    BcdTime_Reset(&time);
+    BcdTime_Add(&time, 0xFFFFFFFFUL);
+    CHECK(Holds(&time, 0xFFFFFFFFUL));
+    BcdTime_Add(&time, 0xFFFFFFFFUL);
+    CHECK(Holds(&time, 0xFFFFFFFFUL));
+}
+
+/**
+ * @brief Reading the clock after the end of the game was backdated
+ */
+static void TestBackdatedEnd(void)
+{
+    bsp_timestamp_t edge;
+    score_clock_t clock;
+
+    ScoreKeeper_Initialize();
+
+    now.ticks = 1000;
+    now.us = 0;
+    ScoreKeeper_Start(&now);
+    ScoreKeeper_Penalty();
+
+    /* The display reads the clock a tick after the finish was touched */
+    edge.ticks = 13456;
+    edge.us = 300;
+    now.ticks = edge.ticks + 1;
+    clock = ScoreKeeper_GetClock();
+    CHECK(Holds(&clock.runningTime, 12457));
+
+    ScoreKeeper_End(&edge);
+
+    clock = ScoreKeeper_GetClock();
+    CHECK(Holds(&clock.runningTime, 12456));
+    CHECK(Holds(&clock.totalTime, 12956));
+}
+
+/**
+ * @brief A finish handled a tick after a display refresh shows the edge time
+ */
+static void TestFinishAfterRefresh(void)
+{
+    bsp_timestamp_t start;
+    bsp_timestamp_t edge;
+    score_clock_t clock;
+    uint8_t before;
+    uint8_t i;
+
+    for (before = 0; before <= 4; before++)
+    {
+        ScoreKeeper_Initialize();
+
+        start.ticks = 500;
+        start.us = 640;
+        ScoreKeeper_Start(&start);
+
+        /* Refreshed every 100 ms, as the display does */
+        for (now.ticks = start.ticks + 100; now.ticks <= 60000; now.ticks += 100)
+        {
+            clock = ScoreKeeper_GetClock();
+        }
+        now.ticks -= 100;
+        CHECK(Holds(&clock.runningTime, now.ticks - start.ticks - 1));
+
+        /* The contact was up to a few ticks before that refresh, and is */
+        /* handled in the frame after it                                  */
+        edge.ticks = now.ticks - before;
+        edge.us = 120;
+        now.ticks++;
+        ScoreKeeper_End(&edge);
+
+        for (i = 0; i < 3; i++)
+        {
+            clock = ScoreKeeper_GetClock();
+            CHECK(Holds(&clock.runningTime, edge.ticks - start.ticks - 1));
+            CHECK(Holds(&clock.totalTime, edge.ticks - start.ticks - 1));
+            now.ticks += 100;
+        }
+    }
+}
+
+int main(void)
+{
+    TestAdd();
+    TestBackdatedEnd();
+    TestFinishAfterRefresh();
+
+    return CheckReport("score_clock");
+}
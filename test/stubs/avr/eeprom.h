@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for <avr/eeprom.h>: the test that needs it defines the
+ * EEPROM.
+ */
+#ifndef _TEST_STUBS_AVR_EEPROM_H
+#define _TEST_STUBS_AVR_EEPROM_H
+
+#include <stddef.h>
+
+void eeprom_read_block(void *dst, const void *src, size_t n);
+
+#endif /* _TEST_STUBS_AVR_EEPROM_H */
@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for <avr/interrupt.h>: an interrupt handler is a function
+ * named after its vector, which a test calls to raise the interrupt.
+ */
+#ifndef _TEST_STUBS_AVR_INTERRUPT_H
+#define _TEST_STUBS_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector) void vector(void); void vector(void)
+
+#define cli()
+#define sei()
+
+#endif /* _TEST_STUBS_AVR_INTERRUPT_H */
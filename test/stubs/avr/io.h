@@ -0,0 +1,40 @@
+/*
+ * Host stand-in for <avr/io.h>: the I/O registers are plain variables,
+ * defined by registers.c, so that the firmware sources build and run on the
+ * development machine.
+ */
+#ifndef _TEST_STUBS_AVR_IO_H
+#define _TEST_STUBS_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+/* Registers, as REG8(name) and REG16(name) entries: */
+#define _TEST_REGISTERS(REG8, REG16) \
+	REG8(PINA) REG8(DDRA) REG8(PORTA) \
+	REG8(PINB) REG8(DDRB) REG8(PORTB) \
+	REG8(PINC) REG8(DDRC) REG8(PORTC) \
+	REG8(PIND) REG8(DDRD) REG8(PORTD) \
+	REG8(SREG) REG8(MCUSR) \
+	REG8(EICRA) REG8(EIFR) REG8(EIMSK) \
+	REG8(EECR) REG8(EEDR) REG16(EEAR) \
+	REG8(TCCR0A) REG8(TCCR0B) REG8(TCNT0) REG8(OCR0A) \
+	REG8(TIFR0) REG8(TIMSK0) \
+	REG8(TCCR2A) REG8(TCCR2B) REG8(TCNT2) REG8(OCR2A) \
+	REG8(TIFR2) REG8(TIMSK2)
+
+/* Bits named by the firmware: */
+#define PINB0  0
+#define PINB1  1
+#define EERIE  3
+#define EEMPE  2
+#define EEPE   1
+#define OCF0A  1
+
+#define _TEST_EXTERN8(name)  extern volatile uint8_t name;
+#define _TEST_EXTERN16(name) extern volatile uint16_t name;
+
+_TEST_REGISTERS(_TEST_EXTERN8, _TEST_EXTERN16)
+
+#endif /* _TEST_STUBS_AVR_IO_H */
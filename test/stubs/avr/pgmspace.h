@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for <avr/pgmspace.h>: program space is ordinary memory.
+ */
+#ifndef _TEST_STUBS_AVR_PGMSPACE_H
+#define _TEST_STUBS_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P               const char*
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t*) (p))
+#define pgm_read_word(p)    (*(const uint16_t*) (p))
+#define pgm_read_dword(p)   (*(const uint32_t*) (p))
+#define pgm_read_ptr(p)     (*(void* const*) (p))
+#define strlen_P(s)         strlen(s)
+
+#endif /* _TEST_STUBS_AVR_PGMSPACE_H */
@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for <avr/sleep.h>: sleeping returns at once.
+ */
+#ifndef _TEST_STUBS_AVR_SLEEP_H
+#define _TEST_STUBS_AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE     0
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_cpu()
+#define sleep_disable()
+
+#endif /* _TEST_STUBS_AVR_SLEEP_H */
@@ -0,0 +1,9 @@
+/*
+ * The I/O registers of the host stand-in for <avr/io.h>.
+ */
+#include <avr/io.h>
+
+#define _TEST_DEFINE8(name)  volatile uint8_t name;
+#define _TEST_DEFINE16(name) volatile uint16_t name;
+
+_TEST_REGISTERS(_TEST_DEFINE8, _TEST_DEFINE16)
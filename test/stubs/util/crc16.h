@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for <util/crc16.h>, for the CRC of the leaderboard copies
+ * that score_keeper.c keeps in the EEPROM: the avr-libc reference
+ * implementation.
+ */
+#ifndef _TEST_STUBS_UTIL_CRC16_H
+#define _TEST_STUBS_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+    int i;
+
+    crc ^= a;
+    for (i = 0; i < 8; ++i)
+    {
+        if (crc & 1)
+            crc = (crc >> 1) ^ 0xA001;
+        else
+            crc = (crc >> 1);
+    }
+
+    return crc;
+}
+
+#endif /* _TEST_STUBS_UTIL_CRC16_H */
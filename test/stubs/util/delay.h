@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for <util/delay.h>: each test provides the delays, which is
+ * where its device models see the time pass.
+ */
+#ifndef _TEST_STUBS_UTIL_DELAY_H
+#define _TEST_STUBS_UTIL_DELAY_H
+
+void _delay_us(double us);
+void _delay_ms(double ms);
+
+#endif /* _TEST_STUBS_UTIL_DELAY_H */
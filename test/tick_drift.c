@@ -0,0 +1,135 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The 1 ms tick of the BSP over 24 hours, for the F_CPU and
+ * BSP_TICK_PRESCALER it is built with.
+ *
+ * The Timer0 registers set by BSP_InitializeTimers are checked against
+ * values worked out here from the clock, not from the BSP_TICK_* macros.
+ * Then a day of ticks is run: each tick lasts OCR0A + 1 counts, as the
+ * timer clears on the count after the match, and the compare interrupt
+ * sets OCR0A for the next one.  The ticks counted must stay within a count
+ * of the clock cycles that went by, at every tick.  The report gives how
+ * far the ticks would drift in a day if they were all OCR0A + 1 counts.
+ */
+
+#include <stdio.h>
+#include <avr/io.h>
+
+#include "bsp/timers.h"
+#include "common/bsp_interface.h"
+
+#include "check.h"
+
+#define DAY_TICKS (24UL * 60 * 60 * BSP_TICK_HZ)
+
+/* Compare interrupt of Timer0, in bsp/timers.c */
+void TIMER0_COMPA_vect(void);
+
+void BSP_SampleInputs(void)
+{
+}
+
+/**
+ * @brief Checks the registers set up for the tick
+ */
+static void TestRegisters(void)
+{
+    static const struct
+    {
+        uint16_t prescaler;
+        uint8_t select;
+    } selects[] = { { 1, 0x01 }, { 8, 0x02 }, { 64, 0x03 }, { 256, 0x04 }, { 1024, 0x05 } };
+    const double countUs = 1e6 * BSP_TICK_PRESCALER / F_CPU;
+    uint8_t select = 0;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(selects) / sizeof(selects[0]); i++)
+    {
+        if (BSP_TICK_PRESCALER == selects[i].prescaler)
+        {
+            select = selects[i].select;
+        }
+    }
+
+    BSP_InitializeTimers();
+
+    CHECK(0x02 == TCCR0A);
+    CHECK(select == TCCR0B);
+    CHECK(0x02 == TIMSK0);
+    CHECK((uint8_t)(F_CPU / (1000UL * BSP_TICK_PRESCALER) - 1) == OCR0A);
+
+    /* The timestamps scale the count to within half a 1/256 us */
+    CHECK(countUs * 256 - 0.5 <= BSP_TICK_COUNT_US_Q8);
+    CHECK(BSP_TICK_COUNT_US_Q8 <= countUs * 256 + 0.5);
+}
+
+/**
+ * @brief Runs a day of ticks and compares them with the clock
+ */
+static void TestDay(void)
+{
+    /* Clock cycles and ticks so far, in cycles * 1000 to stay exact */
+    uint64_t cycles = 0;
+    int64_t error;
+    int64_t worst = 0;
+    uint32_t tick;
+    double fixedDrift;
+
+    BSP_InitializeTimers();
+
+    for (tick = 1; tick <= DAY_TICKS; tick++)
+    {
+        cycles += (OCR0A + 1UL) * BSP_TICK_PRESCALER;
+        TIMER0_COMPA_vect();
+
+        error = (int64_t)(cycles * 1000) - (int64_t)tick * F_CPU;
+        if (error < 0)
+        {
+            error = -error;
+        }
+        if (worst < error)
+        {
+            worst = error;
+        }
+    }
+
+    CHECK(DAY_TICKS == BSPInterface_GetTicks());
+
+    /* Never a whole count off the clock */
+    CHECK(worst < 1000LL * BSP_TICK_PRESCALER);
+
+    /* With every tick OCR0A + 1 counts, the fraction would be lost */
+    fixedDrift = (double)DAY_TICKS * BSP_TICK_REMAINDER * BSP_TICK_PRESCALER /
+        BSP_TICK_DIVISOR / F_CPU;
+
+    printf("%8lu Hz / %-4u OCR0A %3u%s, Q8 %4u: worst %.3f us off over 24 h, "
+        "%.1f s a day without the fraction\n",
+        (unsigned long)F_CPU, BSP_TICK_PRESCALER, (unsigned)(BSP_TICK_COUNTS - 1),
+        (0 < BSP_TICK_REMAINDER) ? "/+1" : "   ", (unsigned)BSP_TICK_COUNT_US_Q8,
+        (double)worst / F_CPU * 1000, fixedDrift);
+}
+
+int main(void)
+{
+    TestRegisters();
+    TestDay();
+
+    return CheckReport("tick_drift");
+}
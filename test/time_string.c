@@ -0,0 +1,150 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The time strings of display.c against the float sprintf they replaced.
+ *
+ * The display is built into this test, so its static BuildTimeString can
+ * be called.  Every tenth from 0:00.0 to 999:59.9 is formatted both ways.
+ * From 10 minutes, the old "%02.0f" rounded the seconds, so "10:60" could
+ * show before the minute rolled over; the new string truncates them, and
+ * is compared with the old one at the whole second.
+ */
+
+#include <stdio.h>
+
+#include "application/display.c"
+
+#include "check.h"
+
+void _delay_us(double us)
+{
+}
+
+void _delay_ms(double ms)
+{
+}
+
+void hd44780_l_init(const struct hd44780_l_conf* conf, uint8_t n, uint8_t f,
+    uint8_t id, uint8_t s)
+{
+}
+
+void hd44780_l_send(const struct hd44780_l_conf* conf, uint8_t rs, uint8_t db,
+    uint16_t w_us)
+{
+}
+
+void BSP_ConfigureDisplay(struct hd44780_l_conf *lcdfw)
+{
+}
+
+void BSP_ConfigureDisplayQueue(struct hd44780fw_conf *fw)
+{
+}
+
+bool (Timer_Initialize)(timer_t *timer, timer_modes_t mode, uint32_t period)
+{
+    return true;
+}
+
+void Timer_SetCallback(timer_t *timer, timer_callback_t callback, void *context)
+{
+}
+
+void Timer_Reset(timer_t *timer)
+{
+}
+
+bool Controller_Subscribe(controller_listener_t l)
+{
+    return true;
+}
+
+const score_clock_t ScoreKeeper_GetClock(void)
+{
+    const score_clock_t clock = { { 0 } };
+
+    return clock;
+}
+
+const score_t ScoreKeeper_GetLastScore(void)
+{
+    const score_t score = { 0 };
+
+    return score;
+}
+
+const int8_t ScoreKeeper_GetRunningTimeRank(void) { return -1; }
+const int8_t ScoreKeeper_GetTotalTimeRank(void) { return -1; }
+const int8_t ScoreKeeper_GetPenaltyRank(void) { return -1; }
+
+/**
+ * @brief Builds a time string as display.c did before the BCD times
+ *
+ * @param s Pointer to a 7-char array
+ * @param ms Time to display
+ */
+static void BuildFloatTimeString(char *s, uint32_t ms)
+{
+    uint16_t minutes = ms / 60000;
+    double seconds = (ms % 60000) / 1000.0f;
+
+    if (0 < minutes)
+    {
+        if (10 <= minutes)
+        {
+            sprintf(s, "%3d:%02.0f", minutes, seconds);
+        }
+        else
+        {
+            sprintf(s, "%d:%04.1f", minutes, seconds);
+        }
+    }
+    else
+    {
+        sprintf(s, "%6.1f", seconds);
+    }
+}
+
+int main(void)
+{
+    char expected[16];
+    char s[7];
+    bcd_time_t time;
+    uint32_t ms;
+
+    BcdTime_Reset(&time);
+
+    for (ms = 0; ms < 1000UL * 60000UL; ms += 100)
+    {
+        BuildTimeString(s, &time);
+        BuildFloatTimeString(expected, (10UL * 60000UL <= ms) ? ms - ms % 1000 : ms);
+
+        if (strcmp(s, expected))
+        {
+            printf("%lu ms: \"%s\", expected \"%s\"\n", (unsigned long)ms, s, expected);
+            CHECK(0);
+            break;
+        }
+
+        BcdTime_Add(&time, 100);
+    }
+
+    return CheckReport("time_string");
+}
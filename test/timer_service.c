@@ -0,0 +1,220 @@
+/*
+BuzzWire Project
+Copyright (C) 2012  Paul Thompson (paul.r.thompson@gmail.com)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The timer service with 10, 50 and 200 timers.
+ *
+ * The frame tick is set by the test.  Each timer counts its callbacks, which
+ * must match its period.  The heap levels a timer moves are read from its
+ * slot: an insert starts at the bottom and a re-armed timer at the top, so
+ * the levels between there and where it stops are the sift loop iterations.
+ *
+ * The cost report turns the levels into cycles with estimates of the
+ * avr-gcc -Os code at 1 MHz, made by hand since there is no AVR toolchain
+ * or simulator here: the fixed cost of an insert (Timer_Reset, Arm, the
+ * slot check), of a sift up and a sift down level (index, pointer and
+ * deadline loads, the 16-bit compare and the Place stores), of a service
+ * pass with nothing due (Frame_GetTicks and one compare) and of each timer
+ * it expires (mode, pending count and callback call).  The CPU share
+ * assumes a service pass every 1 ms tick.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/frame.h"
+#include "common/timers.h"
+
+#include "check.h"
+
+#define INSERT_CYCLES     60   /* Timer_Reset, Arm and Queued      */
+#define SIFT_UP_CYCLES    35   /* One level of SiftUp              */
+#define SIFT_DOWN_CYCLES  50   /* One level of SiftDown            */
+#define IDLE_CYCLES       35   /* Timer_Service with nothing due   */
+#define EXPIRE_CYCLES     80   /* Each expired timer, plus sifting */
+
+#define RUN_TICKS 20000UL
+
+static uint32_t now;
+
+static timer_t timers[TIMER_SERVICE_SIZE];
+static uint32_t fired[TIMER_SERVICE_SIZE];
+
+/* Sift down levels of the timers re-armed by the service */
+static uint32_t downLevels;
+static uint8_t downMost;
+
+uint32_t Frame_GetTicks(void)
+{
+    return now;
+}
+
+/**
+ * @brief Gets the level of a heap position
+ *
+ * @param i Position, from 0
+ * @return Level, 0 at the top
+ */
+static uint8_t Level(uint8_t i)
+{
+    uint8_t level = 0;
+
+    for (i++; 1 < i; i /= 2)
+    {
+        level++;
+    }
+
+    return level;
+}
+
+/**
+ * @brief Counts a callback and the levels its timer went down
+ *
+ * @param context Index of the timer
+ */
+static void Fired(void *context)
+{
+    const uint8_t i = (uint8_t)(uintptr_t)context;
+    const uint8_t level = Level(timers[i].slot - 1);
+
+    fired[i]++;
+    downLevels += level;
+
+    if (downMost < level)
+    {
+        downMost = level;
+    }
+}
+
+/**
+ * @brief Runs a number of recurring timers
+ *
+ * @param count Number of timers
+ */
+static void Run(uint8_t count)
+{
+    uint32_t upLevels = 0;
+    uint8_t upMost = 0;
+    uint32_t expired = 0;
+    uint32_t passes = 0;
+    uint8_t i;
+
+    memset(timers, 0, sizeof(timers));
+    memset(fired, 0, sizeof(fired));
+    downLevels = 0;
+    downMost = 0;
+    now = 1000;
+
+    /* Periods from 997 ms down, so each insert is the earliest yet */
+    for (i = 0; i < count; i++)
+    {
+        uint8_t level;
+
+        Timer_Initialize(&timers[i], TIMER_MODE_RECURRING, 997 - 4 * i);
+        Timer_SetCallback(&timers[i], Fired, (void *)(uintptr_t)i);
+
+        level = Level(i) - Level(timers[i].slot - 1);
+        upLevels += level;
+        if (upMost < level)
+        {
+            upMost = level;
+        }
+    }
+
+    CHECK(0 == upMost || 1 == timers[count - 1].slot);
+    CHECK(Level(count - 1) == upMost);
+
+    for (now++; now <= 1000 + RUN_TICKS; now++)
+    {
+        if (Timer_Due(now))
+        {
+            Timer_Service();
+            passes++;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        CHECK(fired[i] == RUN_TICKS / (997 - 4 * i));
+        expired += fired[i];
+    }
+
+    printf("%3u timers, %u levels: insert up to %2u levels, %4u cycles; "
+        "idle pass %u cycles; expiry %.1f levels (most %u), %3.0f cycles; "
+        "%.1f%% CPU\n",
+        count, Level(count - 1), upMost,
+        INSERT_CYCLES + SIFT_UP_CYCLES * upMost, IDLE_CYCLES,
+        (double)downLevels / expired, downMost,
+        EXPIRE_CYCLES + SIFT_DOWN_CYCLES * (double)downLevels / expired,
+        100.0 * (IDLE_CYCLES * (double)RUN_TICKS +
+            EXPIRE_CYCLES * (double)expired + SIFT_DOWN_CYCLES * (double)downLevels) /
+            (RUN_TICKS * (F_CPU / 1000UL)));
+
+    /* Without a period, a timer leaves the service */
+    for (i = 0; i < count; i++)
+    {
+        Timer_SetTimeoutPeriod(&timers[i], 0);
+    }
+
+    CHECK(!Timer_Due(now + TIMER_SHORT_MAX_PERIOD));
+}
+
+/**
+ * @brief A period a timer cannot hold is rejected, not cut to fit
+ */
+static void TestReject(void)
+{
+    /* Not a constant, so it gets past the build time check */
+    volatile uint32_t tooLong = TIMER_SHORT_MAX_PERIOD + 1;
+    timer_long_t longTimer;
+    uint32_t end;
+
+    memset(timers, 0, sizeof(timers));
+    memset(fired, 0, sizeof(fired));
+    memset(&longTimer, 0, sizeof(longTimer));
+    now = 5000;
+
+    CHECK(!Timer_Initialize(&timers[0], TIMER_MODE_RECURRING, tooLong));
+    CHECK(Timer_Initialize(&timers[1], TIMER_MODE_RECURRING, 100));
+    CHECK(!Timer_SetTimeoutPeriod(&timers[1], tooLong));
+    Timer_SetCallback(&timers[0], Fired, (void *)0);
+    Timer_SetCallback(&timers[1], Fired, (void *)1);
+
+    Timer_InitializeLong(&longTimer, TIMER_MODE_SINGLE, 1000);
+    Timer_SetTimeoutPeriodLong(&longTimer, tooLong);
+
+    for (end = now + 2 * tooLong; now != end; now++)
+    {
+        Timer_Service();
+    }
+
+    CHECK(0 == fired[0] && !Timer_Timeout(&timers[0]));
+    CHECK(0 == fired[1] && !Timer_Timeout(&timers[1]));
+    CHECK(Timer_Timeout(&longTimer.timer));
+    CHECK(!Timer_Due(now + TIMER_SHORT_MAX_PERIOD));
+}
+
+int main(void)
+{
+    Run(10);
+    Run(50);
+    Run(200);
+    TestReject();
+
+    return CheckReport("timer_service");
+}